@@ -0,0 +1,204 @@
+#ifndef _INCLUDE_SOUNDLIB_CACHE_H_
+#define _INCLUDE_SOUNDLIB_CACHE_H_
+
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "smsdk_ext.h"
+#include "SoundFile.h"
+
+#define SOUNDCACHE_MAX_BYTES	(4 * 1024 * 1024)	// Approximate memory the cached entries may use
+
+
+struct SoundCacheStats {
+	unsigned int entries;
+	unsigned int bytes;
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int evictions;
+};
+
+// Shared LRU cache of parsed sound files, keyed by path and by the identity of the
+// file, so a file opened through another path is found as well. Handles opened from
+// the cache share its records. Used from the game thread and the worker threads, so
+// every access goes through the mutex.
+class SoundCache {
+
+private:
+	struct Entry {
+		std::string path;
+		SoundFileStamp stamp;
+		SoundRecordRef record;
+		size_t bytes;
+	};
+
+	typedef std::list<Entry> EntryList;
+	typedef std::map<std::string, EntryList::iterator> EntryMap;
+	typedef std::map<std::pair<long long, long long>, EntryList::iterator> IdentityMap;
+
+	IMutex *lock;
+	EntryList entries;		// Most recently used first
+	EntryMap lookup;
+	IdentityMap identities;	// Device and inode, for the entries whose file system has them
+	size_t bytes;
+	size_t maxBytes;
+
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int evictions;
+
+public:
+	SoundCache() {
+		lock = NULL;
+		bytes = 0;
+		maxBytes = SOUNDCACHE_MAX_BYTES;
+		hits = 0;
+		misses = 0;
+		evictions = 0;
+	}
+
+	bool init() {
+		lock = threader->MakeMutex();
+		return lock != NULL;
+	}
+
+	void shutdown() {
+
+		clear();
+
+		if (lock != NULL) {
+			lock->DestroyThis();
+			lock = NULL;
+		}
+	}
+
+	// Returns true and shares the record if the cached entry for path is still up to date
+	bool find(const char *path, const SoundFileStamp &stamp, SoundRecordRef *record) {
+
+		lock->Lock();
+
+		EntryMap::iterator it = lookup.find(path);
+
+		if (it == lookup.end()) {
+			// The same file may have been opened through another path
+			IdentityMap::iterator identity = stamp.hasIdentity() ? identities.find(identityOf(stamp)) : identities.end();
+
+			if (identity == identities.end() || !(identity->second->stamp == stamp)) {
+				misses++;
+				lock->Unlock();
+				return false;
+			}
+
+			it = lookup.find(identity->second->path);
+		}
+
+		EntryList::iterator entry = it->second;
+
+		if (!(entry->stamp == stamp)) {
+			// The file has been changed since it was cached
+			remove(it);
+			misses++;
+			lock->Unlock();
+			return false;
+		}
+
+		entries.splice(entries.begin(), entries, entry);
+		*record = entry->record;
+		hits++;
+
+		lock->Unlock();
+
+		return true;
+	}
+
+	void store(const char *path, const SoundFileStamp &stamp, const SoundRecordRef &record) {
+
+		lock->Lock();
+
+		EntryMap::iterator it = lookup.find(path);
+
+		if (it != lookup.end()) {
+			remove(it);
+		}
+
+		entries.push_front(Entry());
+
+		Entry &entry = entries.front();
+		const SoundInfo &info = record.info();
+		entry.path = path;
+		entry.stamp = stamp;
+		entry.record = record;
+		entry.bytes = sizeof(Entry) + sizeof(SoundRecord) + entry.path.size() * 2 + info.artist.size() + info.title.size()
+			+ info.album.size() + info.comment.size() + info.genre.size();
+
+		lookup[entry.path] = entries.begin();
+		bytes += entry.bytes;
+
+		if (stamp.hasIdentity()) {
+			identities[identityOf(stamp)] = entries.begin();
+		}
+
+		while (bytes > maxBytes && lookup.size() > 1) {
+			remove(lookup.find(entries.back().path));
+			evictions++;
+		}
+
+		lock->Unlock();
+	}
+
+	void clear() {
+
+		if (lock != NULL) {
+			lock->Lock();
+		}
+
+		entries.clear();
+		lookup.clear();
+		identities.clear();
+		bytes = 0;
+
+		if (lock != NULL) {
+			lock->Unlock();
+		}
+	}
+
+	void getStats(SoundCacheStats *stats) {
+
+		lock->Lock();
+
+		stats->entries = lookup.size();
+		stats->bytes = bytes;
+		stats->hits = hits;
+		stats->misses = misses;
+		stats->evictions = evictions;
+
+		lock->Unlock();
+	}
+
+private:
+
+	static std::pair<long long, long long> identityOf(const SoundFileStamp &stamp) {
+		return std::make_pair(stamp.device, stamp.inode);
+	}
+
+	void remove(EntryMap::iterator it) {
+
+		const SoundFileStamp &stamp = it->second->stamp;
+
+		if (stamp.hasIdentity()) {
+			IdentityMap::iterator identity = identities.find(identityOf(stamp));
+
+			if (identity != identities.end() && identity->second == it->second) {
+				identities.erase(identity);
+			}
+		}
+
+		bytes -= it->second->bytes;
+		entries.erase(it->second);
+		lookup.erase(it);
+	}
+};
+
+#endif // _INCLUDE_SOUNDLIB_CACHE_H_
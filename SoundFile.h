@@ -1,3 +1,6 @@
+#ifndef _INCLUDE_SOUNDLIB_SOUNDFILE_H_
+#define _INCLUDE_SOUNDLIB_SOUNDFILE_H_
+
 
 #ifndef WIN32
 #include <string.h>
@@ -5,13 +8,21 @@
 #include <stdio.h>
 #include <math.h>
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <string>
+
+#if defined _MSC_VER
+#include <intrin.h>
+#endif
+
 #include <IHandleSys.h>
 
 #define TAGLIB_STATIC
 #include <fileref.h>
 #include <tag.h>
 #include "mpeg/mpegfile.h"
-#include "mpeg/xingheader.h"
 #include "riff/wav/wavfile.h"
 
 #include <tbytevector.h>
@@ -19,269 +30,564 @@
 #define SOUNDTYPE_WAVE 0
 #define SOUNDTYPE_MP3 1
 
+#define SOUNDLIB_DURATION_ONLY (1<<0)	// Only read the audio properties, skip all tags
+#define SOUNDLIB_MEMORY_MAP (1<<1)		// Map the file into memory instead of reading it through stdio
+#define SOUNDLIB_EXACT_DURATION (1<<2)	// Count all MP3 frames if there is no VBR header to get the duration from
+
 
 HandleType_t g_SoundFileType;
 
 
-// Because TagLib is hiding members from us we have to trick a little bit...
-class SoundLib_WavFile : public TagLib::RIFF::WAV::File {
+// Identifies the version of a file on disk, cached information is only valid as long as this doesn't change
+struct SoundFileStamp {
+	long long mtime;
+	long long size;
+	long long device;		// Identify the file itself, whatever path it was opened through,
+	long long inode;		// 0 where the file system doesn't have them
+
+	bool read(const char *path) {
+#if defined WIN32
+		struct _stat64 st;
+
+		if (_stat64(path, &st) != 0) {
+			return false;
+		}
+#else
+		// 64-bit sizes on 32-bit builds come from _FILE_OFFSET_BITS=64 in the Makefile
+		struct stat st;
+
+		if (stat(path, &st) != 0) {
+			return false;
+		}
+#endif
+
+		mtime = st.st_mtime;
+		size = st.st_size;
+		device = st.st_dev;
+		inode = st.st_ino;
+
+		return true;
+	}
+
+	// A file replaced by a rename can keep the size and the mtime second, but not the inode
+	bool operator==(const SoundFileStamp &other) const {
+
+		if (mtime != other.mtime || size != other.size) {
+			return false;
+		}
+
+		if (hasIdentity() && other.hasIdentity()) {
+			return device == other.device && inode == other.inode;
+		}
+
+		return true;
+	}
+
+	bool hasIdentity() const {
+		return inode != 0;
+	}
+};
+
+
+// Everything the natives can return for a sound file, read once when the file is
+// opened so it can be cached without keeping TagLib objects around.
+struct SoundInfo {
+	size_t length;
+	float duration;
+	size_t bitRate;
+	size_t samplingRate;
+	size_t channels;
+	size_t num;
+	size_t year;
+	std::string artist;
+	std::string title;
+	std::string album;
+	std::string comment;
+	std::string genre;
+	bool hasTags;			// False until the tags have been read, they are loaded on first use
+	bool exactDuration;		// False if the duration is estimated from the first frame of an MP3
+	unsigned long long sampleCount;	// Samples per channel, the gapless count for LAME encoded MP3s
+	size_t lengthMs;		// Derived from sampleCount and samplingRate, see SoundFile::toMilliseconds()
+};
+
+
+// A parse result shared by every handle, scan and cache entry for the same file. It
+// isn't changed once created, reading the tags creates a new record instead. Handles
+// and scans are released on the game thread while the workers create new references,
+// so the count is atomic.
+class SoundRecord {
+
+private:
+	volatile long refs;
+
+	SoundRecord(const SoundInfo &soundInfo) : info(soundInfo) {
+		refs = 1;
+	}
+
+public:
+	const SoundInfo info;
+
+	// The caller holds the first reference
+	static SoundRecord *create(const SoundInfo &info) {
+		return new SoundRecord(info);
+	}
+
+	void addRef() {
+#if defined _MSC_VER
+		_InterlockedIncrement(&refs);
+#else
+		__sync_add_and_fetch(&refs, 1);
+#endif
+	}
+
+	void release() {
+#if defined _MSC_VER
+		long count = _InterlockedDecrement(&refs);
+#else
+		long count = __sync_sub_and_fetch(&refs, 1);
+#endif
+
+		if (count == 0) {
+			delete this;
+		}
+	}
+};
+
+// Holds a reference to a SoundRecord, copies share the record
+class SoundRecordRef {
+
+private:
+	SoundRecord *record;
 
 public:
-	float getSoundLength() {
-		unsigned int streamLength = 0;
+	SoundRecordRef() {
+		record = NULL;
+	}
+
+	// Takes over the reference of a newly created record
+	explicit SoundRecordRef(SoundRecord *newRecord) {
+		record = newRecord;
+	}
+
+	SoundRecordRef(const SoundRecordRef &other) {
+		record = other.record;
+
+		if (record != NULL) {
+			record->addRef();
+		}
+	}
+
+	~SoundRecordRef() {
+		if (record != NULL) {
+			record->release();
+		}
+	}
+
+	SoundRecordRef &operator=(const SoundRecordRef &other) {
+
+		if (other.record != NULL) {
+			other.record->addRef();
+		}
 
-		for (TagLib::uint i = 0; i < chunkCount(); i++) {
-			if (chunkName(i) == "data") {
-				streamLength = chunkDataSize(i);
-			}
+		if (record != NULL) {
+			record->release();
 		}
 
-		float byteRate = float(audioProperties()->bitrate()) * 125.0f;
+		record = other.record;
 
-		return byteRate > 0.0f ? float(streamLength) / byteRate : 0.0f;
+		return *this;
+	}
+
+	bool isNull() const {
+		return record == NULL;
+	}
+
+	const SoundInfo &info() const {
+		return record->info;
+	}
+
+	bool operator==(const SoundRecordRef &other) const {
+		return record == other.record;
 	}
 };
 
+
+// A handle's view of a parsed sound file. The file is closed as soon as it has been read,
+// the tags are read on first use by opening it again for a moment. The parse result itself
+// is a SoundRecord that handles opened from the cache share.
 class SoundFile {
 
 private:
-	TagLib::File* file;
-	TagLib::Tag* tag;
-	size_t type;
+	bool valid;
+	bool skipTags;
+	int flags;
+	bool stamped;
+	std::string path;
+	SoundFileStamp stamp;
+	SoundRecordRef record;
 
 public:
-	SoundFile(char *path) {
+	// Reads the audio properties, the tags are only read by loadTags()
+	SoundFile(char *path, int flags = 0) {
 
-		file = NULL;
-		tag = NULL;
+		valid = false;
+		skipTags = (flags & SOUNDLIB_DURATION_ONLY) != 0;
+		this->flags = flags;
+		stamped = stamp.read(path);
+		this->path = path;
 
-		char *file_extension = strrchr(path, '.');
+		size_t type;
+		TagLib::File *file = openFile(path, true, flags, &type);
 
-		if (file_extension == NULL) {
+		if (file == NULL) {
 			return;
 		}
 
-		if (strcmp(file_extension, ".wav") == 0) {
-			file = new TagLib::RIFF::WAV::File(path);
-			type = SOUNDTYPE_WAVE;
-		}
-		else if (strcmp(file_extension, ".mp3") == 0) {
-			file = new TagLib::MPEG::File(path);
-			type = SOUNDTYPE_MP3;
+		if (file->isValid()) {
+			SoundInfo info;
+			readInfo(file, type, &info);
+			record = SoundRecordRef(SoundRecord::create(info));
+			valid = true;
 		}
-		else {
-			return;
+
+		delete file;
+	}
+
+	// Creates a sound file from a previously read record, without touching the disk
+	SoundFile(const SoundRecordRef &soundRecord, const char *path, const SoundFileStamp &soundStamp, int flags = 0) {
+
+		valid = true;
+		skipTags = (flags & SOUNDLIB_DURATION_ONLY) != 0;
+		this->flags = flags;
+		stamped = true;
+		stamp = soundStamp;
+		this->path = path;
+		record = soundRecord;
+	}
+
+	// Integer duration, truncated like AudioProperties::length()
+	static size_t toMilliseconds(unsigned long long sampleCount, size_t samplingRate) {
+
+		if (samplingRate == 0) {
+			return 0;
 		}
 
-		loadTag();
+		return (size_t)(sampleCount * 1000 / samplingRate);
 	}
 
-	~SoundFile() {
-		close();
+	// Whether the file extension is one of the formats we can read
+	static bool isSupported(const char *path) {
+
+		const char *file_extension = strrchr(path, '.');
+
+		if (file_extension == NULL) {
+			return false;
+		}
+
+		return strcmp(file_extension, ".wav") == 0 || strcmp(file_extension, ".mp3") == 0;
 	}
 	
+	// Whether the file could be parsed, it isn't kept open either way
 	bool isOpen() {
+		return valid;
+	}
 
-		if (file == NULL) {
+	// Reads the tags if that hasn't happened yet, returns true if the information has changed
+	bool loadTags() {
+
+		if (record.info().hasTags || skipTags) {
 			return false;
 		}
 
-		if (!file->isValid()) {
+		size_t tagType;
+		TagLib::File *tagFile = openFile(path.c_str(), false, flags, &tagType);
+
+		if (tagFile == NULL) {
 			return false;
 		}
-		
+
+		if (!tagFile->isValid()) {
+			delete tagFile;
+			return false;
+		}
+
+		if (tagType == SOUNDTYPE_WAVE) {
+			static_cast<TagLib::RIFF::WAV::File *>(tagFile)->readTags();
+		}
+		else {
+			static_cast<TagLib::MPEG::File *>(tagFile)->readTags();
+		}
+
+		SoundInfo info = record.info();
+		readTagInfo(tagFile->tag(), &info);
+		record = SoundRecordRef(SoundRecord::create(info));
+
+		delete tagFile;
+
 		return true;
 	}
 
-	bool loadTag() {
+	// Switches to a record of the same file version, used to pick up tags another handle has read
+	void setRecord(const SoundRecordRef &soundRecord) {
+		record = soundRecord;
+	}
 
-		if (tag == NULL) {
-			tag = file->tag();
-			return true;
-		}
+	const char *getPath() {
+		return path.c_str();
+	}
 
-		return false;
+	bool isStamped() {
+		return stamped;
 	}
 
-	size_t getSoundDuration() {
+	// Opened with SOUNDLIB_DURATION_ONLY, the tags stay empty
+	bool skipsTags() {
+		return skipTags;
+	}
 
-		TagLib::AudioProperties *properties = file->audioProperties();
+	const SoundFileStamp &getStamp() {
+		return stamp;
+	}
 
-		if (!properties) {
-			return -1;
-		}
+	const SoundInfo &getInfo() {
+		return record.info();
+	}
 
-		if (type == SOUNDTYPE_WAVE) {
-			SoundLib_WavFile* f = (SoundLib_WavFile*)file;
-			return f->audioProperties()->length();
-		}
-		else {
-			TagLib::MPEG::File* f = (TagLib::MPEG::File*)file;
-			return f->audioProperties()->length();
-		}
+	const SoundRecordRef &getRecord() {
+		return record;
+	}
 
-		return 0;
+	size_t getSoundDuration() {
+		return record.info().length;
 	}
 
 	float getSoundDurationFloat() {
-		
-		TagLib::AudioProperties *properties = file->audioProperties();
-		
-		if (!properties) {
-			return -1;
-		}
+		return record.info().duration;
+	}
 
-		if (type == SOUNDTYPE_WAVE) {
-			SoundLib_WavFile* f = (SoundLib_WavFile*)file;
-			return f->getSoundLength();
-		}
-		else {
-			TagLib::MPEG::File* f = (TagLib::MPEG::File*)file;
+	size_t getSoundLengthMs() {
+		return record.info().lengthMs;
+	}
 
-			long first = f->firstFrameOffset();
+	size_t getSoundBitRate() {
+		return record.info().bitRate;
+	}
 
-			f->seek(first);
-			TagLib::MPEG::Header firstHeader(f->readBlock(4));
-			int xingHeaderOffset = TagLib::MPEG::XingHeader::xingHeaderOffset(firstHeader.version(), firstHeader.channelMode());
+	size_t getSoundSamplingRate() {
+		return record.info().samplingRate;
+	}
 
-			f->seek(first + xingHeaderOffset);
-			TagLib::MPEG::XingHeader xingHeader(f->readBlock(16));
+	size_t getSoundChannels() {
+		return record.info().channels;
+	}
 
-			// Read the length and the bitrate from the Xing header.
-			if (xingHeader.isValid() && firstHeader.sampleRate() > 0 && xingHeader.totalFrames() > 0) {
+	const std::string &getSoundArtist() {
+		return record.info().artist;
+	}
 
-				double timePerFrame = double(firstHeader.samplesPerFrame()) / firstHeader.sampleRate();
+	const std::string &getSoundTitle() {
+		return record.info().title;
+	}
 
-				return float(timePerFrame * xingHeader.totalFrames());
-			}
-			else {
-				float byteRate = (float)f->audioProperties()->bitrate() * 125.0f; // 1000 / 8 = 125 (optimization)
-				float length = (float)(f->length() - f->firstFrameOffset()) / byteRate;
+	size_t getSoundNum() {
+		return record.info().num;
+	}
 
-				return length;
-			}
-		}
+	const std::string &getSoundAlbum() {
+		return record.info().album;
+	}
 
-		return 0.0;
+	size_t getSoundYear() {
+		return record.info().year;
 	}
 
-	size_t getSoundBitRate() {
-		
-		TagLib::AudioProperties *properties = file->audioProperties();
+	const std::string &getSoundComment() {
+		return record.info().comment;
+	}
 
-		if (!properties) {
-			return -1;
-		}
+	unsigned long long getSoundSampleCount() {
+		return record.info().sampleCount;
+	}
 
-		return properties->bitrate();
+	const std::string &getSoundGenre() {
+		return record.info().genre;
 	}
 
-	size_t getSoundSamplingRate() {
-		
-		TagLib::AudioProperties *properties = file->audioProperties();
 
-		if (!properties) {
-			return -1;
+private:
+
+	// TagLib falls back to stdio by itself if the file can't be mapped
+	static TagLib::File *openFile(const char *path, bool readProperties, int flags, size_t *type) {
+
+		const char *file_extension = strrchr(path, '.');
+
+		if (file_extension == NULL) {
+			return NULL;
 		}
 
-		return properties->sampleRate();
+		bool memoryMap = (flags & SOUNDLIB_MEMORY_MAP) != 0;
+		TagLib::AudioProperties::ReadStyle style = (flags & SOUNDLIB_EXACT_DURATION) ? TagLib::AudioProperties::Accurate : TagLib::AudioProperties::Average;
+
+		if (strcmp(file_extension, ".wav") == 0) {
+			*type = SOUNDTYPE_WAVE;
+			return new TagLib::RIFF::WAV::File(path, readProperties, style, false, memoryMap);
+		}
+		else if (strcmp(file_extension, ".mp3") == 0) {
+			*type = SOUNDTYPE_MP3;
+			return new TagLib::MPEG::File(path, TagLib::ID3v2::FrameFactory::instance(), readProperties, style, false, memoryMap);
+		}
+
+		return NULL;
 	}
 
-	void getSoundArtist(char *buf, size_t size) {
+	static void readInfo(TagLib::File *file, size_t type, SoundInfo *info) {
 
-		if (!tag) {
-			buf[0] = '\0';
-			return;
+		info->length = readSoundDuration(file, type);
+		info->bitRate = readSoundBitRate(file);
+		info->samplingRate = readSoundSamplingRate(file);
+		info->channels = readSoundChannels(file);
+		info->exactDuration = readSoundDurationExact(file, type);
+		info->sampleCount = readSoundSampleCount(file, type);
+		info->duration = readSoundDurationFloat(file, info->sampleCount, info->samplingRate);
+		info->lengthMs = toMilliseconds(info->sampleCount, info->samplingRate);
+
+		info->num = -1;
+		info->year = -1;
+		info->hasTags = false;
+	}
+
+	static void readTagInfo(TagLib::Tag *tag, SoundInfo *info) {
+
+		if (tag) {
+			info->num = tag->track();
+			info->year = tag->year();
+			readTagString(tag->artist(), &info->artist);
+			readTagString(tag->title(), &info->title);
+			readTagString(tag->album(), &info->album);
+			readTagString(tag->comment(), &info->comment);
+			readTagString(tag->genre(), &info->genre);
 		}
 
-		TagLib::String tl_str = tag->artist();
-		const char *str = tl_str.toCString(true);
-		strncpy(buf, str, size);
+		info->hasTags = true;
+	}
 
-		return;
+	// Converts to UTF-8 once and keeps that buffer, toCString() would copy it twice more
+	static void readTagString(const TagLib::String &str, std::string *out) {
+		str.to8Bit(true).swap(*out);
 	}
 
-	void getSoundTitle(char *buf, size_t size) {
+	static size_t readSoundDuration(TagLib::File *file, size_t type) {
 
-		if (!tag) {
-			buf[0] = '\0';
-			return;
+		TagLib::AudioProperties *properties = file->audioProperties();
+
+		if (!properties) {
+			return -1;
 		}
 
-		TagLib::String tl_str = tag->title();
-		const char *str = tl_str.toCString(true);
-		strncpy(buf, str, size);
+		if (type == SOUNDTYPE_WAVE) {
+			TagLib::RIFF::WAV::File* f = (TagLib::RIFF::WAV::File*)file;
+			return f->audioProperties()->length();
+		}
+		else {
+			TagLib::MPEG::File* f = (TagLib::MPEG::File*)file;
+			return f->audioProperties()->length();
+		}
 
-		return;
+		return 0;
 	}
 
-	size_t getSoundNum() {
+	static float readSoundDurationFloat(TagLib::File *file, unsigned long long sampleCount, size_t samplingRate) {
 
-		if (!tag) {
+		if (!file->audioProperties()) {
 			return -1;
 		}
 
-		return tag->track();
+		if (samplingRate == 0) {
+			return 0.0;
+		}
+
+		return (float)((double)sampleCount / samplingRate);
 	}
 
-	void getSoundAlbum(char *buf, size_t size) {
+	static unsigned long long readSoundSampleCount(TagLib::File *file, size_t type) {
 
-		if (!tag) {
-			buf[0] = '\0';
-			return;
+		if (!file->audioProperties()) {
+			return 0;
 		}
 
-		TagLib::String tl_str = tag->album();
-		const char *str = tl_str.toCString(true);
-		strncpy(buf, str, size);
+		if (type == SOUNDTYPE_WAVE) {
+			TagLib::RIFF::WAV::File* f = (TagLib::RIFF::WAV::File*)file;
+			return f->audioProperties()->sampleFrames();
+		}
 
-		return;
-	}
+		TagLib::MPEG::File* f = (TagLib::MPEG::File*)file;
 
-	size_t getSoundYear() {
+		// From a Xing header without the LAME encoder delay and padding, a VBRI header, or all
+		// frames have been counted (SOUNDLIB_EXACT_DURATION)
+		if (f->audioProperties()->sampleCount() > 0) {
+			return f->audioProperties()->sampleCount();
+		}
 
-		if (!tag) {
-			return -1;
+		// Estimated from the bitrate of the first frame, exact for CBR files:
+		// bytes * 8 / (kbps * 1000) seconds. The stream length is known from parsing
+		// the file, so this doesn't read anything.
+		unsigned long long bitRate = f->audioProperties()->bitrate();
+		unsigned long long streamLength = f->audioProperties()->streamLength();
+
+		if (bitRate == 0) {
+			return 0;
 		}
 
-		return tag->year();
+		return streamLength * 8 * f->audioProperties()->sampleRate() / (bitRate * 1000);
 	}
 
-	void getSoundComment(char *buf, size_t size) {
+	static bool readSoundDurationExact(TagLib::File *file, size_t type) {
 
-		if (!tag) {
-			buf[0] = '\0';
-			return;
+		if (type == SOUNDTYPE_WAVE) {
+			TagLib::RIFF::WAV::Properties *properties = static_cast<TagLib::RIFF::WAV::File *>(file)->audioProperties();
+
+			// Counted for PCM or from a fact chunk, estimated from the byte rate otherwise
+			return properties != NULL && properties->isSampleFramesExact();
 		}
 
-		TagLib::String tl_str = tag->comment();
-		const char *str = tl_str.toCString(true);
-		strncpy(buf, str, size);
+		TagLib::MPEG::Properties *properties = static_cast<TagLib::MPEG::File *>(file)->audioProperties();
 
-		return;
+		// Known from a VBR header or from counting the frames
+		return properties != NULL && properties->sampleCount() > 0;
 	}
 
-	void getSoundGenre(char *buf, size_t size) {
+	static size_t readSoundBitRate(TagLib::File *file) {
+		
+		TagLib::AudioProperties *properties = file->audioProperties();
 
-		if (!tag) {
-			buf[0] = '\0';
-			return;
+		if (!properties) {
+			return -1;
 		}
 
-		TagLib::String tl_str = tag->genre();
-		const char *str = tl_str.toCString(true);
-		strncpy(buf, str, size);
-
-		return;
+		return properties->bitrate();
 	}
 
+	static size_t readSoundSamplingRate(TagLib::File *file) {
+		
+		TagLib::AudioProperties *properties = file->audioProperties();
 
-private:
+		if (!properties) {
+			return -1;
+		}
 
-	void close() {
+		return properties->sampleRate();
+	}
 
-		delete file;
+	static size_t readSoundChannels(TagLib::File *file) {
+		
+		TagLib::AudioProperties *properties = file->audioProperties();
 
-		return;
+		if (!properties) {
+			return -1;
+		}
+
+		return properties->channels();
 	}
-};
\ No newline at end of file
+};
+
+#endif // _INCLUDE_SOUNDLIB_SOUNDFILE_H_
@@ -0,0 +1,598 @@
+#ifndef _INCLUDE_SOUNDLIB_INDEX_H_
+#define _INCLUDE_SOUNDLIB_INDEX_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined WIN32
+#include <direct.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+#include "smsdk_ext.h"
+#include "SoundFile.h"
+#include "SoundCache.h"
+
+#define SOUNDINDEX_MAGIC		0x58494C53	// "SLIX"
+#define SOUNDINDEX_VERSION		5
+#define SOUNDINDEX_DIR			"data/soundlib"
+#define SOUNDINDEX_FILE			"data/soundlib/index.dat"
+#define SOUNDINDEX_HAS_TAGS		(1<<0)		// Record flag, the tag strings have been read
+#define SOUNDINDEX_EXACT_DURATION	(1<<1)		// Record flag, the duration isn't an estimate
+#define SOUNDINDEX_MIN_COMPACT	(64 * 1024)	// Stale records are only dropped once the file is bigger than this
+
+
+// Index file layout: a SoundIndexHeader followed by records. Each record is a
+// SoundIndexRecord followed by the path and the tag strings (not terminated),
+// padded to 8 bytes. A changed file is appended again, the last record wins.
+struct SoundIndexHeader {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int recordSize;	// sizeof(SoundIndexRecord), catches builds with a different layout
+	unsigned int reserved;
+};
+
+enum SoundIndexString {
+	SoundIndex_Path = 0,
+	SoundIndex_Artist,
+	SoundIndex_Title,
+	SoundIndex_Album,
+	SoundIndex_Comment,
+	SoundIndex_Genre,
+	SoundIndex_NumStrings
+};
+
+struct SoundIndexRecord {
+	long long mtime;
+	long long size;
+	long long device;		// 0 where the file system has no inodes, see SoundFileStamp
+	long long inode;
+	unsigned long long sampleCount;
+	unsigned int recordSize;
+	float duration;
+	unsigned int length;
+	unsigned int bitRate;
+	unsigned int samplingRate;
+	unsigned int channels;
+	unsigned int num;
+	unsigned int year;
+	unsigned short strings[SoundIndex_NumStrings];
+	unsigned int flags;
+};
+
+struct SoundIndexStats {
+	unsigned int entries;
+	unsigned int bytes;
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int writes;
+};
+
+// Persistent metadata of every parsed sound file, so a restarted server doesn't
+// have to parse them again. The file is mapped once when the extension loads,
+// records added afterwards are appended to the file and kept in memory.
+class SoundIndex {
+
+private:
+	typedef std::map<std::string, size_t> OffsetMap;
+
+	IMutex *lock;
+	FILE *output;
+	OffsetMap lookup;			// Path -> record offset, mapped records first, then appended ones
+	std::vector<char> appended;
+	size_t appendedLive;		// Bytes of appended records that are still the current one of their path
+
+	const char *mapping;
+	size_t mappingSize;
+#if defined WIN32
+	HANDLE mappingFile;
+	HANDLE mappingObject;
+#endif
+
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int writes;
+
+public:
+	SoundIndex() {
+		lock = NULL;
+		output = NULL;
+		appendedLive = 0;
+		mapping = NULL;
+		mappingSize = 0;
+#if defined WIN32
+		mappingFile = INVALID_HANDLE_VALUE;
+		mappingObject = NULL;
+#endif
+		hits = 0;
+		misses = 0;
+		writes = 0;
+	}
+
+	bool init() {
+
+		lock = threader->MakeMutex();
+
+		if (lock == NULL) {
+			return false;
+		}
+
+		char path[PLATFORM_MAX_PATH];
+
+		g_pSM->BuildPath(Path_SM, path, sizeof(path), SOUNDINDEX_DIR);
+#if defined WIN32
+		_mkdir(path);
+#else
+		mkdir(path, 0755);
+#endif
+
+		g_pSM->BuildPath(Path_SM, path, sizeof(path), SOUNDINDEX_FILE);
+
+		bool loaded = load(path);
+
+		if (!loaded) {
+			// Missing, outdated or damaged, start with an empty index
+			unload();
+			loaded = rewrite(path) && load(path);
+		}
+
+		if (loaded) {
+			output = fopen(path, "ab");
+		} else {
+			// Never append to a file with a stale header, keep the index in memory only
+			unload();
+		}
+
+		return true;
+	}
+
+	void shutdown() {
+
+		if (output != NULL) {
+			fclose(output);
+			output = NULL;
+		}
+
+		unload();
+
+		if (lock != NULL) {
+			lock->DestroyThis();
+			lock = NULL;
+		}
+	}
+
+	// Returns true and fills info if the index has an up to date record for path
+	bool find(const char *path, const SoundFileStamp &stamp, SoundInfo *info) {
+
+		if (lock == NULL) {
+			return false;
+		}
+
+		lock->Lock();
+
+		OffsetMap::iterator it = lookup.find(path);
+
+		if (it == lookup.end()) {
+			misses++;
+			lock->Unlock();
+			return false;
+		}
+
+		SoundIndexRecord record;
+		const char *data = getRecord(it->second, &record);
+
+		if (!isCurrent(record, stamp)) {
+			misses++;
+			lock->Unlock();
+			return false;
+		}
+
+		readRecord(record, data, info);
+		hits++;
+
+		lock->Unlock();
+
+		return true;
+	}
+
+	void store(const char *path, const SoundFileStamp &stamp, const SoundInfo &info) {
+
+		if (lock == NULL) {
+			return;
+		}
+
+		std::vector<char> buffer;
+
+		if (!writeRecord(path, stamp, info, &buffer)) {
+			return;
+		}
+
+		lock->Lock();
+
+		OffsetMap::iterator it = lookup.find(path);
+
+		if (it != lookup.end() && it->second >= mappingSize) {
+			SoundIndexRecord previous;
+			getRecord(it->second, &previous);
+			appendedLive -= previous.recordSize;
+		}
+
+		lookup[path] = mappingSize + appended.size();
+		appended.insert(appended.end(), buffer.begin(), buffer.end());
+		appendedLive += buffer.size();
+
+		// Files that keep changing would otherwise grow the memory copy until the next load
+		if (appended.size() > SOUNDINDEX_MIN_COMPACT && appendedLive < appended.size() / 2) {
+			compactAppended();
+		}
+
+		if (output != NULL) {
+			fwrite(&buffer[0], 1, buffer.size(), output);
+			fflush(output);
+		}
+
+		writes++;
+
+		lock->Unlock();
+	}
+
+	void getStats(SoundIndexStats *stats) {
+
+		if (lock == NULL) {
+			memset(stats, 0, sizeof(SoundIndexStats));
+			return;
+		}
+
+		lock->Lock();
+
+		stats->entries = lookup.size();
+		stats->bytes = mappingSize + appended.size();
+		stats->hits = hits;
+		stats->misses = misses;
+		stats->writes = writes;
+
+		lock->Unlock();
+	}
+
+private:
+
+	// Maps the index and builds the lookup table, drops stale records if they take up most of the file
+	bool load(const char *path) {
+
+		if (!map(path) || mappingSize < sizeof(SoundIndexHeader)) {
+			return false;
+		}
+
+		SoundIndexHeader header;
+		memcpy(&header, mapping, sizeof(header));
+
+		if (header.magic != SOUNDINDEX_MAGIC || header.version != SOUNDINDEX_VERSION || header.recordSize != sizeof(SoundIndexRecord)) {
+			return false;
+		}
+
+		size_t offset = sizeof(SoundIndexHeader);
+
+		while (offset + sizeof(SoundIndexRecord) <= mappingSize) {
+
+			SoundIndexRecord record;
+			memcpy(&record, mapping + offset, sizeof(record));
+
+			if (record.recordSize < sizeof(SoundIndexRecord) || record.recordSize > mappingSize - offset
+				|| getStringsSize(record) > record.recordSize - sizeof(SoundIndexRecord)) {
+				break;
+			}
+
+			const char *recordPath = mapping + offset + sizeof(SoundIndexRecord);
+
+			lookup[std::string(recordPath, record.strings[SoundIndex_Path])] = offset;
+			offset += record.recordSize;
+		}
+
+		size_t live = sizeof(SoundIndexHeader);
+
+		for (OffsetMap::iterator it = lookup.begin(); it != lookup.end(); ++it) {
+			SoundIndexRecord record;
+			getRecord(it->second, &record);
+			live += record.recordSize;
+		}
+
+		// A partly written record at the end (crash while appending) or too many stale records
+		if (offset != mappingSize || (mappingSize > SOUNDINDEX_MIN_COMPACT && live < mappingSize / 2)) {
+
+			if (!rewrite(path)) {
+				return false;
+			}
+
+			unload();
+
+			return load(path);
+		}
+
+		return true;
+	}
+
+	// Writes a new index holding only the current record of every path
+	bool rewrite(const char *path) {
+
+		char tmppath[PLATFORM_MAX_PATH + 8];
+		snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
+
+		FILE *fp = fopen(tmppath, "wb");
+
+		if (fp == NULL) {
+			return false;
+		}
+
+		SoundIndexHeader header;
+		header.magic = SOUNDINDEX_MAGIC;
+		header.version = SOUNDINDEX_VERSION;
+		header.recordSize = sizeof(SoundIndexRecord);
+		header.reserved = 0;
+
+		bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+
+		for (OffsetMap::iterator it = lookup.begin(); ok && it != lookup.end(); ++it) {
+			SoundIndexRecord record;
+			const char *data = getRecord(it->second, &record);
+
+			ok = fwrite(data, 1, record.recordSize, fp) == record.recordSize;
+		}
+
+		ok = (fclose(fp) == 0) && ok;
+
+		// The old file has to be unmapped before it can be replaced on Windows
+		unmap();
+
+		if (!ok) {
+			remove(tmppath);
+			return false;
+		}
+
+#if defined WIN32
+		remove(path);
+#endif
+
+		return rename(tmppath, path) == 0;
+	}
+
+	void unload() {
+		unmap();
+		lookup.clear();
+		appended.clear();
+		appendedLive = 0;
+	}
+
+	// Drops the replaced records from the memory copy, the file is only compacted by load()
+	void compactAppended() {
+
+		std::vector<char> live;
+		live.reserve(appendedLive);
+
+		for (OffsetMap::iterator it = lookup.begin(); it != lookup.end(); ++it) {
+			if (it->second < mappingSize) {
+				continue;
+			}
+
+			SoundIndexRecord record;
+			const char *data = getRecord(it->second, &record);
+
+			it->second = mappingSize + live.size();
+			live.insert(live.end(), data, data + record.recordSize);
+		}
+
+		appended.swap(live);
+	}
+
+	// Copies the fixed part of the record at offset and returns the start of the record
+	const char *getRecord(size_t offset, SoundIndexRecord *record) {
+
+		const char *data = offset < mappingSize ? mapping + offset : &appended[offset - mappingSize];
+		memcpy(record, data, sizeof(SoundIndexRecord));
+
+		return data;
+	}
+
+	// Like SoundFileStamp::operator==, the identity is only compared if both sides have one
+	static bool isCurrent(const SoundIndexRecord &record, const SoundFileStamp &stamp) {
+
+		if (record.mtime != stamp.mtime || record.size != stamp.size) {
+			return false;
+		}
+
+		if (record.inode != 0 && stamp.hasIdentity()) {
+			return record.device == stamp.device && record.inode == stamp.inode;
+		}
+
+		return true;
+	}
+
+	// Total length of the strings behind the record, can't overflow as each one is at most 0xFFFF
+	static size_t getStringsSize(const SoundIndexRecord &record) {
+
+		size_t size = 0;
+
+		for (int i = 0; i < SoundIndex_NumStrings; i++) {
+			size += record.strings[i];
+		}
+
+		return size;
+	}
+
+	static void readRecord(const SoundIndexRecord &record, const char *data, SoundInfo *info) {
+
+		info->length = record.length;
+		info->duration = record.duration;
+		info->sampleCount = record.sampleCount;
+		info->lengthMs = SoundFile::toMilliseconds(record.sampleCount, record.samplingRate);
+		info->bitRate = record.bitRate;
+		info->samplingRate = record.samplingRate;
+		info->channels = record.channels;
+		info->num = record.num;
+		info->year = record.year;
+		info->hasTags = (record.flags & SOUNDINDEX_HAS_TAGS) != 0;
+		info->exactDuration = (record.flags & SOUNDINDEX_EXACT_DURATION) != 0;
+
+		std::string *strings[SoundIndex_NumStrings] = {
+			NULL, &info->artist, &info->title, &info->album, &info->comment, &info->genre
+		};
+
+		const char *str = data + sizeof(SoundIndexRecord);
+
+		for (int i = 0; i < SoundIndex_NumStrings; i++) {
+			if (strings[i] != NULL) {
+				strings[i]->assign(str, record.strings[i]);
+			}
+
+			str += record.strings[i];
+		}
+	}
+
+	static bool writeRecord(const char *path, const SoundFileStamp &stamp, const SoundInfo &info, std::vector<char> *buffer) {
+
+		const char *strings[SoundIndex_NumStrings] = {
+			path, info.artist.c_str(), info.title.c_str(), info.album.c_str(), info.comment.c_str(), info.genre.c_str()
+		};
+		size_t lengths[SoundIndex_NumStrings] = {
+			strlen(path), info.artist.size(), info.title.size(), info.album.size(), info.comment.size(), info.genre.size()
+		};
+
+		SoundIndexRecord record;
+		memset(&record, 0, sizeof(record));
+
+		size_t recordSize = sizeof(SoundIndexRecord);
+
+		for (int i = 0; i < SoundIndex_NumStrings; i++) {
+			if (lengths[i] > 0xFFFF) {
+				return false;
+			}
+
+			record.strings[i] = (unsigned short)lengths[i];
+			recordSize += lengths[i];
+		}
+
+		recordSize = (recordSize + 7) & ~7;
+
+		record.mtime = stamp.mtime;
+		record.size = stamp.size;
+		record.device = stamp.device;
+		record.inode = stamp.inode;
+		record.recordSize = recordSize;
+		record.duration = info.duration;
+		record.sampleCount = info.sampleCount;
+		record.length = info.length;
+		record.bitRate = info.bitRate;
+		record.samplingRate = info.samplingRate;
+		record.channels = info.channels;
+		record.num = info.num;
+		record.year = info.year;
+		record.flags = (info.hasTags ? SOUNDINDEX_HAS_TAGS : 0) | (info.exactDuration ? SOUNDINDEX_EXACT_DURATION : 0);
+
+		buffer->assign(recordSize, 0);
+		memcpy(&(*buffer)[0], &record, sizeof(record));
+
+		char *str = &(*buffer)[sizeof(SoundIndexRecord)];
+
+		for (int i = 0; i < SoundIndex_NumStrings; i++) {
+			memcpy(str, strings[i], lengths[i]);
+			str += lengths[i];
+		}
+
+		return true;
+	}
+
+	bool map(const char *path) {
+
+#if defined WIN32
+		mappingFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+		if (mappingFile == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+
+		DWORD size = GetFileSize(mappingFile, NULL);
+
+		if (size == INVALID_FILE_SIZE || size == 0) {
+			unmap();
+			return false;
+		}
+
+		mappingObject = CreateFileMappingA(mappingFile, NULL, PAGE_READONLY, 0, 0, NULL);
+
+		if (mappingObject == NULL) {
+			unmap();
+			return false;
+		}
+
+		mapping = (const char *)MapViewOfFile(mappingObject, FILE_MAP_READ, 0, 0, 0);
+
+		if (mapping == NULL) {
+			unmap();
+			return false;
+		}
+
+		mappingSize = size;
+#else
+		int fd = open(path, O_RDONLY);
+
+		if (fd < 0) {
+			return false;
+		}
+
+		struct stat st;
+
+		if (fstat(fd, &st) != 0 || st.st_size == 0) {
+			close(fd);
+			return false;
+		}
+
+		void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+		// The mapping stays valid after the descriptor is closed
+		close(fd);
+
+		if (data == MAP_FAILED) {
+			return false;
+		}
+
+		mapping = (const char *)data;
+		mappingSize = st.st_size;
+#endif
+
+		return true;
+	}
+
+	void unmap() {
+
+#if defined WIN32
+		if (mapping != NULL) {
+			UnmapViewOfFile(mapping);
+		}
+
+		if (mappingObject != NULL) {
+			CloseHandle(mappingObject);
+			mappingObject = NULL;
+		}
+
+		if (mappingFile != INVALID_HANDLE_VALUE) {
+			CloseHandle(mappingFile);
+			mappingFile = INVALID_HANDLE_VALUE;
+		}
+#else
+		if (mapping != NULL) {
+			munmap((void *)mapping, mappingSize);
+		}
+#endif
+
+		mapping = NULL;
+		mappingSize = 0;
+	}
+};
+
+#endif // _INCLUDE_SOUNDLIB_INDEX_H_
@@ -0,0 +1,81 @@
+#ifndef _INCLUDE_SOUNDLIB_SCAN_H_
+#define _INCLUDE_SOUNDLIB_SCAN_H_
+
+#include <string>
+#include <vector>
+
+#include "smsdk_ext.h"
+#include "SoundFile.h"
+
+#define SOUNDSCAN_MAX_DEPTH		16	// Guards against symlink loops in recursive scans
+
+
+HandleType_t g_SoundScanType;
+
+
+struct SoundScanEntry {
+	std::string name;		// Path as passed to the scan, plus the path inside the scanned directory
+	std::string path;		// Full path, to read the tags later on
+	SoundFileStamp stamp;
+	SoundRecordRef record;	// Shared with the cache and the handles opened from the scan
+	bool valid;
+};
+
+// Result of ScanSoundDirectory(), every supported file that could be parsed
+class SoundScan {
+
+public:
+	std::vector<SoundScanEntry> entries;
+	int flags;
+
+	SoundScan() {
+		flags = 0;
+	}
+
+	// Appends the paths of all supported sound files below dir, relative to it
+	static void listDirectory(const char *dir, const char *relative, bool recursive, int depth, std::vector<std::string> *files) {
+
+		char path[PLATFORM_MAX_PATH];
+
+		if (relative[0] == '\0') {
+			snprintf(path, sizeof(path), "%s", dir);
+		}
+		else {
+			snprintf(path, sizeof(path), "%s/%s", dir, relative);
+		}
+
+		IDirectory *directory = libsys->OpenDirectory(path);
+
+		if (directory == NULL) {
+			return;
+		}
+
+		while (directory->MoreFiles()) {
+
+			const char *entry = directory->GetEntryName();
+			std::string name;
+
+			if (relative[0] == '\0') {
+				name = entry;
+			}
+			else {
+				name = std::string(relative) + "/" + entry;
+			}
+
+			if (directory->IsEntryDirectory()) {
+				if (recursive && depth < SOUNDSCAN_MAX_DEPTH && strcmp(entry, ".") != 0 && strcmp(entry, "..") != 0) {
+					listDirectory(dir, name.c_str(), recursive, depth + 1, files);
+				}
+			}
+			else if (directory->IsEntryFile() && SoundFile::isSupported(entry)) {
+				files->push_back(name);
+			}
+
+			directory->NextEntry();
+		}
+
+		libsys->CloseDirectory(directory);
+	}
+};
+
+#endif // _INCLUDE_SOUNDLIB_SCAN_H_
@@ -0,0 +1,313 @@
+#ifndef _INCLUDE_SOUNDLIB_THREADPOOL_H_
+#define _INCLUDE_SOUNDLIB_THREADPOOL_H_
+
+#include <deque>
+#include <vector>
+
+#include "smsdk_ext.h"
+
+#ifndef WIN32
+#include <unistd.h>
+#include <sys/time.h>
+#endif
+
+#define SOUNDPOOL_MAX_THREADS	4		// Upper bound for the number of worker threads
+#define SOUNDPOOL_MAX_QUEUE		4096	// Jobs that may wait for a worker before new ones are refused
+
+
+// A unit of work for the pool: run() is executed on a worker thread,
+// complete() afterwards on the game thread.
+class SoundJob {
+
+public:
+	double queuedAt;
+
+	virtual ~SoundJob() {}
+
+	virtual void run() = 0;
+	virtual void complete() = 0;
+};
+
+struct SoundPoolStats {
+	unsigned int threads;
+	unsigned int queued;
+	unsigned int running;
+	unsigned int completed;
+	double avgLatency;
+	double maxLatency;
+};
+
+class SoundThreadPool : public IThread {
+
+private:
+	IMutex *lock;
+	IEventSignal *signal;		// Wakes idle workers, not latched on Linux, see runFrame() and stop()
+	std::vector<IThreadHandle *> threads;
+	std::deque<SoundJob *> queue;
+	std::deque<SoundJob *> done;
+	volatile bool shutdown;
+
+	unsigned int alive;
+	unsigned int waiting;
+	unsigned int running;
+	unsigned int completed;
+	double totalLatency;
+	double maxLatency;
+
+public:
+	SoundThreadPool() {
+		lock = NULL;
+		signal = NULL;
+		shutdown = false;
+		alive = 0;
+		waiting = 0;
+		running = 0;
+		completed = 0;
+		totalLatency = 0.0;
+		maxLatency = 0.0;
+	}
+
+	static double getTime() {
+#if defined WIN32
+		LARGE_INTEGER frequency, counter;
+		QueryPerformanceFrequency(&frequency);
+		QueryPerformanceCounter(&counter);
+
+		return double(counter.QuadPart) / double(frequency.QuadPart);
+#else
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+
+		return tv.tv_sec + tv.tv_usec / 1000000.0;
+#endif
+	}
+
+	static unsigned int getProcessorCount() {
+#if defined WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+
+		return info.dwNumberOfProcessors;
+#else
+		long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+		return count > 0 ? (unsigned int)count : 1;
+#endif
+	}
+
+	bool start(unsigned int numThreads) {
+
+		lock = threader->MakeMutex();
+
+		if (lock == NULL) {
+			return false;
+		}
+
+		signal = threader->MakeEventSignal();
+
+		if (signal == NULL) {
+			lock->DestroyThis();
+			lock = NULL;
+			return false;
+		}
+
+		shutdown = false;
+
+		for (unsigned int i = 0; i < numThreads; i++) {
+			lock->Lock();
+			alive++;
+			lock->Unlock();
+
+			IThreadHandle *handle = threader->MakeThread(this, Thread_Default);
+
+			if (handle == NULL) {
+				lock->Lock();
+				alive--;
+				lock->Unlock();
+				break;
+			}
+
+			threads.push_back(handle);
+		}
+
+		return !threads.empty();
+	}
+
+	// Joins all workers, jobs that have not been delivered yet are dropped.
+	void stop() {
+
+		shutdown = true;
+
+		// A signal that arrives before a worker waits for it is lost on Linux,
+		// so keep waking the workers until all of them have returned.
+		while (lock != NULL && signal != NULL) {
+			lock->Lock();
+			unsigned int left = alive;
+			lock->Unlock();
+
+			if (left == 0) {
+				break;
+			}
+
+			for (unsigned int i = 0; i < left; i++) {
+				signal->Signal();
+			}
+
+			threader->ThreadSleep(1);
+		}
+
+		for (size_t i = 0; i < threads.size(); i++) {
+			threads[i]->WaitForThread();
+			threads[i]->DestroyThis();
+		}
+		threads.clear();
+
+		while (!queue.empty()) {
+			delete queue.front();
+			queue.pop_front();
+		}
+
+		while (!done.empty()) {
+			delete done.front();
+			done.pop_front();
+		}
+
+		if (signal != NULL) {
+			signal->DestroyThis();
+			signal = NULL;
+		}
+
+		if (lock != NULL) {
+			lock->DestroyThis();
+			lock = NULL;
+		}
+	}
+
+	unsigned int getThreadCount() {
+		return threads.size();
+	}
+
+	// Game thread only
+	bool addJob(SoundJob *job) {
+
+		if (lock == NULL) {
+			return false;
+		}
+
+		lock->Lock();
+
+		if (queue.size() >= SOUNDPOOL_MAX_QUEUE) {
+			lock->Unlock();
+			return false;
+		}
+
+		job->queuedAt = getTime();
+		queue.push_back(job);
+
+		lock->Unlock();
+
+		signal->Signal();
+
+		return true;
+	}
+
+	// Game thread only, hands finished jobs back to their owners.
+	void runFrame() {
+
+		if (lock == NULL) {
+			return;
+		}
+
+		std::deque<SoundJob *> finished;
+
+		lock->Lock();
+		finished.swap(done);
+		// Catches a wake up that got lost between a worker's last look at the queue and its wait
+		bool wake = !queue.empty() && waiting > 0;
+		lock->Unlock();
+
+		if (wake) {
+			signal->Signal();
+		}
+
+		double now = getTime();
+
+		while (!finished.empty()) {
+			SoundJob *job = finished.front();
+			finished.pop_front();
+
+			double latency = now - job->queuedAt;
+
+			totalLatency += latency;
+			if (latency > maxLatency) {
+				maxLatency = latency;
+			}
+			completed++;
+
+			job->complete();
+			delete job;
+		}
+	}
+
+	void getStats(SoundPoolStats *stats) {
+
+		stats->threads = threads.size();
+		stats->completed = completed;
+		stats->avgLatency = completed > 0 ? totalLatency / completed : 0.0;
+		stats->maxLatency = maxLatency;
+
+		if (lock == NULL) {
+			stats->queued = 0;
+			stats->running = 0;
+			return;
+		}
+
+		lock->Lock();
+		stats->queued = queue.size();
+		stats->running = running;
+		lock->Unlock();
+	}
+
+	void RunThread(IThreadHandle *pHandle) {
+
+		while (!shutdown) {
+
+			lock->Lock();
+
+			if (queue.empty()) {
+				waiting++;
+				lock->Unlock();
+
+				signal->Wait();
+
+				lock->Lock();
+				waiting--;
+				lock->Unlock();
+				continue;
+			}
+
+			SoundJob *job = queue.front();
+			queue.pop_front();
+			running++;
+
+			lock->Unlock();
+
+			job->run();
+
+			lock->Lock();
+			running--;
+			done.push_back(job);
+			lock->Unlock();
+		}
+
+		lock->Lock();
+		alive--;
+		lock->Unlock();
+	}
+
+	void OnTerminate(IThreadHandle *pHandle, bool cancel) {
+
+	}
+};
+
+#endif // _INCLUDE_SOUNDLIB_THREADPOOL_H_
@@ -79,6 +79,9 @@ IThreader *threader = NULL;
 #if defined SMEXT_ENABLE_LIBSYS
 ILibrarySys *libsys = NULL;
 #endif
+#if defined SMEXT_ENABLE_ROOTCONSOLEMENU
+IRootConsole *rootconsole = NULL;
+#endif
 
 /** Exports the main interface */
 PLATFORM_EXTERN_C IExtensionInterface *GetSMExtAPI()
@@ -149,6 +152,9 @@ bool SDKExtension::OnExtensionLoad(IExtension *me, IShareSys *sys, char *error,
 #if defined SMEXT_ENABLE_LIBSYS
 	SM_GET_IFACE(LIBRARYSYS, libsys);
 #endif
+#if defined SMEXT_ENABLE_ROOTCONSOLEMENU
+	SM_GET_IFACE(ROOTCONSOLE, rootconsole);
+#endif
 
 	if (SDK_OnLoad(error, maxlength, late))
 	{
@@ -73,6 +73,9 @@
 #if defined SMEXT_ENABLE_LIBSYS
 #include <ILibrarySys.h>
 #endif
+#if defined SMEXT_ENABLE_ROOTCONSOLEMENU
+#include <IRootConsoleMenu.h>
+#endif
 
 #if defined SMEXT_CONF_METAMOD
 #include <ISmmPlugin.h>
@@ -256,6 +259,9 @@ extern IThreader *threader;
 #if defined SMEXT_ENABLE_LIBSYS
 extern ILibrarySys *libsys;
 #endif
+#if defined SMEXT_ENABLE_ROOTCONSOLEMENU
+extern IRootConsole *rootconsole;
+#endif
 
 #if defined SMEXT_CONF_METAMOD
 PLUGIN_GLOBALVARS();
@@ -1,6 +1,13 @@
 
 #include "sound-duration.h"
 #include "SoundFile.h"
+#include "SoundThreadPool.h"
+#include "SoundCache.h"
+#include "SoundIndex.h"
+#include "SoundScan.h"
+
+#include <id3v2framefactory.h>
+#include "mpeg/id3v1/id3v1genres.h"
 
 #define SIZEOFARRAY(ARRAY) sizeof(ARRAY) / sizeof(ARRAY[0])
 
@@ -24,36 +31,586 @@ public:
 /* Create an instance of the handler */
 FileTypeHandler g_FileTypeHandler;
 
+class ScanTypeHandler : public IHandleTypeDispatch
+{
+public:
+	void OnHandleDestroy(HandleType_t type, void *object)
+	{
+		delete (SoundScan *)object;
+	}
+};
+
+ScanTypeHandler g_ScanTypeHandler;
 
-static cell_t OpenSoundFile(IPluginContext *pContext, const cell_t *params) {
-	char *name;
+/* Worker threads for OpenSoundFileAsync() */
+SoundThreadPool g_SoundThreadPool;
+
+/* Parsed files, shared by all plugins */
+SoundCache g_SoundCache;
+
+/* Parsed files, kept on disk across server restarts */
+SoundIndex g_SoundIndex;
+
+
+// Estimated durations don't do for SOUNDLIB_EXACT_DURATION, those files are parsed again
+static bool IsInfoUsable(const SoundInfo &info, int flags) {
+	return info.exactDuration || !(flags & SOUNDLIB_EXACT_DURATION);
+}
+
+// Files that haven't changed since they were parsed the last time are served from the cache or the index.
+// Handles opened from the cache share its record, so the file is parsed and its strings are copied once.
+static SoundFile *OpenSound(char *path, int flags) {
+
+	SoundFileStamp stamp;
+	bool stamped = stamp.read(path);
+
+	SoundRecordRef record;
+
+	if (stamped && g_SoundCache.find(path, stamp, &record) && IsInfoUsable(record.info(), flags)) {
+		return new SoundFile(record, path, stamp, flags);
+	}
+
+	SoundInfo info;
+
+	if (stamped && g_SoundIndex.find(path, stamp, &info) && IsInfoUsable(info, flags)) {
+		record = SoundRecordRef(SoundRecord::create(info));
+		g_SoundCache.store(path, stamp, record);
+		return new SoundFile(record, path, stamp, flags);
+	}
+
+	SoundFile *soundfile = new SoundFile(path, flags);
+
+	if (!soundfile->isOpen()) {
+		delete soundfile;
+		return NULL;
+	}
+
+	if (soundfile->isStamped()) {
+		g_SoundCache.store(path, soundfile->getStamp(), soundfile->getRecord());
+		g_SoundIndex.store(path, soundfile->getStamp(), soundfile->getInfo());
+	}
+
+	return soundfile;
+}
+
+// Tags are only read once a plugin asks for them, afterwards they are cached as well
+static void LoadSoundTags(SoundFile *soundfile) {
+
+	if (soundfile->getInfo().hasTags || soundfile->skipsTags()) {
+		return;
+	}
+
+	// Another handle of the same file may have read them already
+	SoundRecordRef record;
+
+	if (soundfile->isStamped() && g_SoundCache.find(soundfile->getPath(), soundfile->getStamp(), &record)
+		&& record.info().hasTags) {
+		soundfile->setRecord(record);
+		return;
+	}
+
+	if (!soundfile->loadTags() || !soundfile->isStamped()) {
+		return;
+	}
+
+	// Don't mix up the properties and the tags of different versions of the file
+	SoundFileStamp stamp;
+
+	if (stamp.read(soundfile->getPath()) && stamp == soundfile->getStamp()) {
+		g_SoundCache.store(soundfile->getPath(), stamp, soundfile->getRecord());
+		g_SoundIndex.store(soundfile->getPath(), stamp, soundfile->getInfo());
+	}
+}
+
+
+// Parses a sound file on a worker thread and passes the handle to the plugin's callback
+class SoundOpenJob : public SoundJob {
+
+public:
+	char name[PLATFORM_MAX_PATH];
+	char path[PLATFORM_MAX_PATH];
+	IChangeableForward *callback;
+	IdentityToken_t *owner;
+	cell_t data;
+	int flags;
+	SoundFile *soundfile;
+
+	SoundOpenJob() {
+		callback = NULL;
+		owner = NULL;
+		data = 0;
+		flags = 0;
+		soundfile = NULL;
+	}
+
+	~SoundOpenJob() {
+		delete soundfile;
+
+		if (callback != NULL) {
+			forwards->ReleaseForward(callback);
+		}
+	}
+
+	void run() {
+		soundfile = OpenSound(path, flags);
+	}
+
+	void complete() {
+
+		// The forward loses its function when the plugin gets unloaded
+		if (callback->GetFunctionCount() == 0) {
+			return;
+		}
+
+		Handle_t hndl = BAD_HANDLE;
+
+		if (soundfile != NULL) {
+			hndl = g_pHandleSys->CreateHandle(g_SoundFileType, soundfile, owner, myself->GetIdentity(), NULL);
+
+			if (hndl != BAD_HANDLE) {
+				soundfile = NULL;
+			}
+		}
+
+		callback->PushCell(hndl);
+		callback->PushString(name);
+		callback->PushCell(data);
+		callback->Execute(NULL);
+	}
+};
+
+// Shared by the jobs of one ScanSoundDirectory() call, only touched on the game thread
+// except for the parts of entries a job has been given.
+class SoundScanState {
+
+public:
+	char name[PLATFORM_MAX_PATH];
+	char path[PLATFORM_MAX_PATH];
+	bool recursive;
+	int flags;
+	IChangeableForward *callback;
+	IdentityToken_t *owner;
+	cell_t data;
+	std::vector<std::string> files;
+	std::vector<SoundScanEntry> entries;
+	unsigned int pending;
+	unsigned int refs;
+
+	SoundScanState() {
+		recursive = false;
+		flags = 0;
+		callback = NULL;
+		owner = NULL;
+		data = 0;
+		pending = 0;
+		refs = 0;
+	}
+
+	~SoundScanState() {
+		if (callback != NULL) {
+			forwards->ReleaseForward(callback);
+		}
+	}
+
+	void release() {
+		if (--refs == 0) {
+			delete this;
+		}
+	}
+
+	// Called once every file has been parsed
+	void finish() {
+
+		if (callback->GetFunctionCount() == 0) {
+			return;
+		}
+
+		SoundScan *scan = new SoundScan();
+		scan->flags = flags;
+
+		for (size_t i = 0; i < entries.size(); i++) {
+			if (entries[i].valid) {
+				scan->entries.push_back(entries[i]);
+			}
+		}
+
+		Handle_t hndl = g_pHandleSys->CreateHandle(g_SoundScanType, scan, owner, myself->GetIdentity(), NULL);
+
+		if (hndl == BAD_HANDLE) {
+			delete scan;
+		}
+
+		callback->PushCell(hndl);
+		callback->PushString(name);
+		callback->PushCell(data);
+		callback->Execute(NULL);
+	}
+};
+
+// Parses a slice of the files found by a scan
+class SoundScanParseJob : public SoundJob {
+
+public:
+	SoundScanState *state;
+	size_t begin;
+	size_t end;
+
+	SoundScanParseJob(SoundScanState *scanState, size_t first, size_t last) {
+		state = scanState;
+		state->refs++;
+		begin = first;
+		end = last;
+	}
+
+	~SoundScanParseJob() {
+		state->release();
+	}
+
+	void run() {
+
+		char realpath[PLATFORM_MAX_PATH];
+
+		for (size_t i = begin; i < end; i++) {
+			std::string path = std::string(state->path) + "/" + state->files[i];
+
+			if (path.size() >= sizeof(realpath)) {
+				continue;
+			}
+
+			strcpy(realpath, path.c_str());
+
+			SoundFile *soundfile = OpenSound(realpath, state->flags);
+
+			if (soundfile != NULL) {
+				state->entries[i].path = soundfile->getPath();
+				state->entries[i].stamp = soundfile->getStamp();
+				state->entries[i].record = soundfile->getRecord();
+				state->entries[i].valid = true;
+				delete soundfile;
+			}
+		}
+	}
+
+	void complete() {
+
+		if (--state->pending == 0) {
+			state->finish();
+		}
+	}
+};
+
+// Lists the directory on a worker thread, then splits the files up between the workers
+class SoundScanListJob : public SoundJob {
+
+public:
+	SoundScanState *state;
+
+	SoundScanListJob(SoundScanState *scanState) {
+		state = scanState;
+		state->refs++;
+	}
+
+	~SoundScanListJob() {
+		state->release();
+	}
+
+	void run() {
+
+		SoundScan::listDirectory(state->path, "", state->recursive, 0, &state->files);
+
+		state->entries.resize(state->files.size());
+
+		for (size_t i = 0; i < state->files.size(); i++) {
+			if (state->name[0] == '\0') {
+				state->entries[i].name = state->files[i];
+			}
+			else {
+				state->entries[i].name = std::string(state->name) + "/" + state->files[i];
+			}
+			state->entries[i].valid = false;
+		}
+	}
+
+	void complete() {
+
+		size_t count = state->files.size();
+
+		if (count == 0) {
+			state->finish();
+			return;
+		}
+
+		// A few slices per worker, so one slow file doesn't hold up the others
+		size_t slices = g_SoundThreadPool.getThreadCount() * 4;
+		size_t sliceSize = (count + slices - 1) / slices;
+
+		std::vector<SoundScanParseJob *> jobs;
+
+		for (size_t begin = 0; begin < count; begin += sliceSize) {
+			size_t end = begin + sliceSize < count ? begin + sliceSize : count;
+
+			jobs.push_back(new SoundScanParseJob(state, begin, end));
+		}
+
+		state->pending = jobs.size();
+
+		for (size_t i = 0; i < jobs.size(); i++) {
+			if (!g_SoundThreadPool.addJob(jobs[i])) {
+				// The queue is full, parse this slice right away
+				jobs[i]->run();
+				jobs[i]->complete();
+				delete jobs[i];
+			}
+		}
+	}
+};
+
+static void OnGameFrame(bool simulating) {
+	g_SoundThreadPool.runFrame();
+}
+
+static bool BuildSoundPath(IPluginContext *pContext, cell_t file, bool relativeToSound, char **name, char *realpath, size_t maxlength) {
 	int err;
-	if ((err=pContext->LocalToString(params[1], &name)) != SP_ERROR_NONE) {
+	if ((err=pContext->LocalToString(file, name)) != SP_ERROR_NONE) {
 		pContext->ThrowNativeErrorEx(err, NULL);
-		return 0;
+		return false;
 	}
 
-	if (strlen(name) > (PLATFORM_MAX_PATH-7)) {
+	if (strlen(*name) > (PLATFORM_MAX_PATH-7)) {
 		pContext->ThrowNativeError("Specified Path too long");
+		return false;
+	}
+
+	if (relativeToSound) {
+		g_pSM->BuildPath(Path_Game, realpath, maxlength, "sound/%s", *name);
+	}
+	else {
+		strcpy(realpath, *name);
+	}
+
+	return true;
+}
+
+static cell_t OpenSoundFile(IPluginContext *pContext, const cell_t *params) {
+	char *name;
+	char realpath[PLATFORM_MAX_PATH];
+
+	if (!BuildSoundPath(pContext, params[1], params[2] != 0, &name, realpath, sizeof(realpath))) {
+		return 0;
+	}
+
+	// Flags were added later, older plugins don't pass them
+	int flags = params[0] >= 3 ? params[3] : 0;
+
+	SoundFile *soundfile = OpenSound(realpath, flags);
+
+	if (soundfile == NULL) {
 		return 0;
 	}
 
+	Handle_t hndl = g_pHandleSys->CreateHandle(g_SoundFileType, soundfile, pContext->GetIdentity(), myself->GetIdentity(), NULL);
+
+	if (hndl == BAD_HANDLE) {
+		delete soundfile;
+	}
+
+	return hndl;
+}
+
+static cell_t OpenSoundFileAsync(IPluginContext *pContext, const cell_t *params) {
+	char *name;
 	char realpath[PLATFORM_MAX_PATH];
 
-	if (params[2]) {
-		g_pSM->BuildPath(Path_Game, realpath, sizeof(realpath), "sound/%s", name);
+	if (!BuildSoundPath(pContext, params[1], params[4] != 0, &name, realpath, sizeof(realpath))) {
+		return 0;
 	}
-	else {
-		strcpy(realpath, name);
+
+	IPluginFunction *pFunction = pContext->GetFunctionById(params[2]);
+
+	if (!pFunction) {
+		return pContext->ThrowNativeError("Invalid function id (%X)", params[2]);
 	}
 
-	SoundFile *soundfile = new SoundFile(realpath);
+	SoundOpenJob *job = new SoundOpenJob();
 
-	if (!soundfile->isOpen()) {
+	strcpy(job->name, name);
+	strcpy(job->path, realpath);
+	job->owner = pContext->GetIdentity();
+	job->data = params[3];
+	job->flags = params[0] >= 5 ? params[5] : 0;
+	job->callback = forwards->CreateForwardEx(NULL, ET_Ignore, 3, NULL, Param_Cell, Param_String, Param_Cell);
+	job->callback->AddFunction(pFunction);
+
+	if (!g_SoundThreadPool.addJob(job)) {
+		delete job;
 		return 0;
 	}
 
-	return g_pHandleSys->CreateHandle(g_SoundFileType, soundfile, pContext->GetIdentity(), myself->GetIdentity(), NULL);
+	return 1;
+}
+
+static cell_t ScanSoundDirectory(IPluginContext *pContext, const cell_t *params) {
+	char *name;
+	char realpath[PLATFORM_MAX_PATH];
+
+	if (!BuildSoundPath(pContext, params[1], params[5] != 0, &name, realpath, sizeof(realpath))) {
+		return 0;
+	}
+
+	IPluginFunction *pFunction = pContext->GetFunctionById(params[3]);
+
+	if (!pFunction) {
+		return pContext->ThrowNativeError("Invalid function id (%X)", params[3]);
+	}
+
+	SoundScanState *state = new SoundScanState();
+
+	strcpy(state->name, name);
+	strcpy(state->path, realpath);
+
+	// Entries are joined with a slash, don't end up with two of them
+	size_t length = strlen(state->name);
+	if (length > 0 && (state->name[length-1] == '/' || state->name[length-1] == '\\')) {
+		state->name[length-1] = '\0';
+	}
+
+	length = strlen(state->path);
+	if (length > 0 && (state->path[length-1] == '/' || state->path[length-1] == '\\')) {
+		state->path[length-1] = '\0';
+	}
+
+	state->recursive = params[2] != 0;
+	state->flags = params[0] >= 6 ? params[6] : 0;
+	state->owner = pContext->GetIdentity();
+	state->data = params[4];
+	state->callback = forwards->CreateForwardEx(NULL, ET_Ignore, 3, NULL, Param_Cell, Param_String, Param_Cell);
+	state->callback->AddFunction(pFunction);
+
+	SoundScanListJob *job = new SoundScanListJob(state);
+
+	if (!g_SoundThreadPool.addJob(job)) {
+		delete job;
+		return 0;
+	}
+
+	return 1;
+}
+
+static SoundScan *ReadSoundScan(IPluginContext *pContext, cell_t handle, cell_t index, bool checkIndex) {
+	Handle_t hndl = static_cast<Handle_t>(handle);
+	HandleError err;
+	HandleSecurity sec;
+ 
+	/* Build our security descriptor */
+	sec.pOwner = NULL;	/* Not needed, owner access is not checked */
+	sec.pIdentity = myself->GetIdentity();	/* But only this extension can read */
+ 
+	SoundScan *scan;
+	if ((err = g_pHandleSys->ReadHandle(hndl, g_SoundScanType, &sec, (void **)&scan))
+	     != HandleError_None)
+	{
+		pContext->ThrowNativeError("Invalid sound-scan handle %x (error %d)", hndl, err);
+		return NULL;
+	}
+
+	if (checkIndex && (index < 0 || (size_t)index >= scan->entries.size())) {
+		pContext->ThrowNativeError("Invalid sound-scan index %d (count: %d)", index, (int)scan->entries.size());
+		return NULL;
+	}
+
+	return scan;
+}
+
+static cell_t GetSoundScanCount(IPluginContext *pContext, const cell_t *params) {
+	SoundScan *scan = ReadSoundScan(pContext, params[1], 0, false);
+
+	if (scan == NULL) {
+		return 0;
+	}
+
+	return scan->entries.size();
+}
+
+static cell_t GetSoundScanFile(IPluginContext *pContext, const cell_t *params) {
+	SoundScan *scan = ReadSoundScan(pContext, params[1], params[2], true);
+
+	if (scan == NULL) {
+		return 0;
+	}
+
+	size_t written;
+	pContext->StringToLocalUTF8(params[3], params[4], scan->entries[params[2]].name.c_str(), &written);
+
+	return written;
+}
+
+static cell_t GetSoundScanLength(IPluginContext *pContext, const cell_t *params) {
+	SoundScan *scan = ReadSoundScan(pContext, params[1], params[2], true);
+
+	if (scan == NULL) {
+		return 0;
+	}
+
+	return sp_ftoc(scan->entries[params[2]].record.info().duration);
+}
+
+static cell_t OpenSoundScanFile(IPluginContext *pContext, const cell_t *params) {
+	SoundScan *scan = ReadSoundScan(pContext, params[1], params[2], true);
+
+	if (scan == NULL) {
+		return 0;
+	}
+
+	const SoundScanEntry &entry = scan->entries[params[2]];
+	SoundFile *soundfile = new SoundFile(entry.record, entry.path.c_str(), entry.stamp, scan->flags);
+
+	Handle_t hndl = g_pHandleSys->CreateHandle(g_SoundFileType, soundfile, pContext->GetIdentity(), myself->GetIdentity(), NULL);
+
+	if (hndl == BAD_HANDLE) {
+		delete soundfile;
+	}
+
+	return hndl;
+}
+
+static cell_t GetSoundAsyncStats(IPluginContext *pContext, const cell_t *params) {
+	SoundPoolStats stats;
+	g_SoundThreadPool.getStats(&stats);
+
+	cell_t *queued, *running, *avgLatency, *maxLatency;
+	int err;
+	if ((err=pContext->LocalToPhysAddr(params[1], &queued)) != SP_ERROR_NONE
+		|| (err=pContext->LocalToPhysAddr(params[2], &running)) != SP_ERROR_NONE
+		|| (err=pContext->LocalToPhysAddr(params[3], &avgLatency)) != SP_ERROR_NONE
+		|| (err=pContext->LocalToPhysAddr(params[4], &maxLatency)) != SP_ERROR_NONE) {
+		return pContext->ThrowNativeErrorEx(err, NULL);
+	}
+
+	*queued = stats.queued;
+	*running = stats.running;
+	*avgLatency = sp_ftoc(float(stats.avgLatency));
+	*maxLatency = sp_ftoc(float(stats.maxLatency));
+
+	return stats.completed;
+}
+
+static cell_t GetSoundCacheStats(IPluginContext *pContext, const cell_t *params) {
+	SoundCacheStats stats;
+	g_SoundCache.getStats(&stats);
+
+	cell_t *hits, *misses, *evictions;
+	int err;
+	if ((err=pContext->LocalToPhysAddr(params[1], &hits)) != SP_ERROR_NONE
+		|| (err=pContext->LocalToPhysAddr(params[2], &misses)) != SP_ERROR_NONE
+		|| (err=pContext->LocalToPhysAddr(params[3], &evictions)) != SP_ERROR_NONE) {
+		return pContext->ThrowNativeErrorEx(err, NULL);
+	}
+
+	*hits = stats.hits;
+	*misses = stats.misses;
+	*evictions = stats.evictions;
+
+	return stats.entries;
 }
 
 static cell_t GetSoundLength(IPluginContext *pContext, const cell_t *params)
@@ -96,6 +653,26 @@ static cell_t GetSoundLengthFloat(IPluginContext *pContext, const cell_t *params
 	return sp_ftoc(soundfile->getSoundDurationFloat());
 }
 
+static cell_t GetSoundLengthMs(IPluginContext *pContext, const cell_t *params)
+{
+	Handle_t hndl = static_cast<Handle_t>(params[1]);
+	HandleError err;
+	HandleSecurity sec;
+ 
+	/* Build our security descriptor */
+	sec.pOwner = NULL;	/* Not needed, owner access is not checked */
+	sec.pIdentity = myself->GetIdentity();	/* But only this extension can read */
+ 
+	SoundFile *soundfile;
+	if ((err = g_pHandleSys->ReadHandle(hndl, g_SoundFileType, &sec, (void **)&soundfile))
+	     != HandleError_None)
+	{
+		return pContext->ThrowNativeError("Invalid sound-file handle %x (error %d)", hndl, err);
+	}
+ 
+	return soundfile->getSoundLengthMs();
+}
+
 static cell_t GetSoundBitRate(IPluginContext *pContext, const cell_t *params) {
 	Handle_t hndl = static_cast<Handle_t>(params[1]);
 	HandleError err;
@@ -134,6 +711,66 @@ static cell_t GetSoundSamplingRate(IPluginContext *pContext, const cell_t *param
 	return soundfile->getSoundSamplingRate();
 }
 
+static cell_t GetSoundChannels(IPluginContext *pContext, const cell_t *params) {
+	Handle_t hndl = static_cast<Handle_t>(params[1]);
+	HandleError err;
+	HandleSecurity sec;
+ 
+	/* Build our security descriptor */
+	sec.pOwner = NULL;	/* Not needed, owner access is not checked */
+	sec.pIdentity = myself->GetIdentity();	/* But only this extension can read */
+ 
+	SoundFile *soundfile;
+	if ((err = g_pHandleSys->ReadHandle(hndl, g_SoundFileType, &sec, (void **)&soundfile))
+	     != HandleError_None)
+	{
+		return pContext->ThrowNativeError("Invalid sound-file handle %x (error %d)", hndl, err);
+	}
+
+	return soundfile->getSoundChannels();
+}
+
+static cell_t GetSoundSampleCount(IPluginContext *pContext, const cell_t *params) {
+	Handle_t hndl = static_cast<Handle_t>(params[1]);
+	HandleError err;
+	HandleSecurity sec;
+ 
+	/* Build our security descriptor */
+	sec.pOwner = NULL;	/* Not needed, owner access is not checked */
+	sec.pIdentity = myself->GetIdentity();	/* But only this extension can read */
+ 
+	SoundFile *soundfile;
+	if ((err = g_pHandleSys->ReadHandle(hndl, g_SoundFileType, &sec, (void **)&soundfile))
+	     != HandleError_None)
+	{
+		return pContext->ThrowNativeError("Invalid sound-file handle %x (error %d)", hndl, err);
+	}
+
+	unsigned long long sampleCount = soundfile->getSoundSampleCount();
+
+	cell_t *count;
+	int addrErr;
+	if ((addrErr=pContext->LocalToPhysAddr(params[2], &count)) != SP_ERROR_NONE) {
+		return pContext->ThrowNativeErrorEx(addrErr, NULL);
+	}
+
+	count[0] = (cell_t)(sampleCount & 0xFFFFFFFF);
+	count[1] = (cell_t)(sampleCount >> 32);
+
+	return soundfile->getInfo().exactDuration;
+}
+
+// Writes a UTF-8 string straight into the plugin's buffer, cut at a character boundary if it doesn't fit.
+// Returns the full length in bytes, so plugins can tell when their buffer was too small.
+static cell_t CopySoundString(IPluginContext *pContext, cell_t buffer, cell_t maxlength, const std::string &str) {
+
+	if (maxlength > 0) {
+		pContext->StringToLocalUTF8(buffer, static_cast<size_t>(maxlength), str.c_str(), NULL);
+	}
+
+	return str.size();
+}
+
 static cell_t GetSoundArtist(IPluginContext *pContext, const cell_t *params) {
 	Handle_t hndl = static_cast<Handle_t>(params[1]);
 	HandleError err;
@@ -150,10 +787,9 @@ static cell_t GetSoundArtist(IPluginContext *pContext, const cell_t *params) {
 		return pContext->ThrowNativeError("Invalid sound-file handle %x (error %d)", hndl, err);
 	}
 
-	char str[128];
-	soundfile->getSoundArtist(str, SIZEOFARRAY(str));
+	LoadSoundTags(soundfile);
 
-	return pContext->StringToLocalUTF8(params[2], static_cast<size_t>(params[3]), str, NULL);
+	return CopySoundString(pContext, params[2], params[3], soundfile->getSoundArtist());
 }
 
 static cell_t GetSoundTitle(IPluginContext *pContext, const cell_t *params) {
@@ -172,10 +808,9 @@ static cell_t GetSoundTitle(IPluginContext *pContext, const cell_t *params) {
 		return pContext->ThrowNativeError("Invalid sound-file handle %x (error %d)", hndl, err);
 	}
 
-	char str[128];
-	soundfile->getSoundTitle(str, SIZEOFARRAY(str));
+	LoadSoundTags(soundfile);
 
-	return pContext->StringToLocalUTF8(params[2], static_cast<size_t>(params[3]), str, NULL);
+	return CopySoundString(pContext, params[2], params[3], soundfile->getSoundTitle());
 }
 
 static cell_t GetSoundNum(IPluginContext *pContext, const cell_t *params) {
@@ -194,6 +829,8 @@ static cell_t GetSoundNum(IPluginContext *pContext, const cell_t *params) {
 		return pContext->ThrowNativeError("Invalid sound-file handle %x (error %d)", hndl, err);
 	}
 
+	LoadSoundTags(soundfile);
+
 	return soundfile->getSoundNum();
 }
 
@@ -213,10 +850,9 @@ static cell_t GetSoundAlbum(IPluginContext *pContext, const cell_t *params) {
 		return pContext->ThrowNativeError("Invalid sound-file handle %x (error %d)", hndl, err);
 	}
 
-	char str[128];
-	soundfile->getSoundAlbum(str, SIZEOFARRAY(str));
+	LoadSoundTags(soundfile);
 
-	return pContext->StringToLocalUTF8(params[2], static_cast<size_t>(params[3]), str, NULL);
+	return CopySoundString(pContext, params[2], params[3], soundfile->getSoundAlbum());
 }
 
 static cell_t GetSoundYear(IPluginContext *pContext, const cell_t *params) {
@@ -235,6 +871,8 @@ static cell_t GetSoundYear(IPluginContext *pContext, const cell_t *params) {
 		return pContext->ThrowNativeError("Invalid sound-file handle %x (error %d)", hndl, err);
 	}
 
+	LoadSoundTags(soundfile);
+
 	return  soundfile->getSoundYear();
 
 
@@ -256,10 +894,9 @@ static cell_t GetSoundComment(IPluginContext *pContext, const cell_t *params) {
 		return pContext->ThrowNativeError("Invalid sound-file handle %x (error %d)", hndl, err);
 	}
 
-	char str[1024];
-	soundfile->getSoundComment(str, SIZEOFARRAY(str));
+	LoadSoundTags(soundfile);
 
-	return pContext->StringToLocalUTF8(params[2], static_cast<size_t>(params[3]), str, NULL);
+	return CopySoundString(pContext, params[2], params[3], soundfile->getSoundComment());
 }
 
 static cell_t GetSoundGenre(IPluginContext *pContext, const cell_t *params) {
@@ -278,10 +915,105 @@ static cell_t GetSoundGenre(IPluginContext *pContext, const cell_t *params) {
 		return pContext->ThrowNativeError("Invalid sound-file handle %x (error %d)", hndl, err);
 	}
 
-	char str[1024];
-	soundfile->getSoundGenre(str, SIZEOFARRAY(str));
+	LoadSoundTags(soundfile);
+
+	return CopySoundString(pContext, params[2], params[3], soundfile->getSoundGenre());
+}
+
+// Field order of the SoundInfo enum in soundlib.inc
+enum SoundInfoField {
+	SoundInfo_Length = 0,
+	SoundInfo_LengthFloat,
+	SoundInfo_BitRate,
+	SoundInfo_SamplingRate,
+	SoundInfo_Channels,
+	SoundInfo_Num,
+	SoundInfo_Year,
+	SoundInfo_LengthMs,
+	SoundInfo_Count
+};
+
+static cell_t GetSoundInfo(IPluginContext *pContext, const cell_t *params) {
+	Handle_t hndl = static_cast<Handle_t>(params[1]);
+	HandleError err;
+	HandleSecurity sec;
+ 
+	/* Build our security descriptor */
+	sec.pOwner = NULL;	/* Not needed, owner access is not checked */
+	sec.pIdentity = myself->GetIdentity();	/* But only this extension can read */
+ 
+	SoundFile *soundfile;
+	if ((err = g_pHandleSys->ReadHandle(hndl, g_SoundFileType, &sec, (void **)&soundfile))
+	     != HandleError_None)
+	{
+		return pContext->ThrowNativeError("Invalid sound-file handle %x (error %d)", hndl, err);
+	}
+
+	// Plugins compiled against an older include pass a smaller array
+	cell_t count = params[3] < SoundInfo_Count ? params[3] : SoundInfo_Count;
+
+	if (count <= 0) {
+		return 0;
+	}
+
+	// Track number and year come from the tags, they stay -1 for callers that don't ask for
+	// them unless another native has read the tags already. The parameter was added later.
+	bool readTags = params[0] >= 4 ? params[4] != 0 : true;
+
+	if (readTags && count > SoundInfo_Num) {
+		LoadSoundTags(soundfile);
+	}
+
+	const SoundInfo &info = soundfile->getInfo();
+
+	cell_t fields[SoundInfo_Count];
+	fields[SoundInfo_Length] = info.length;
+	fields[SoundInfo_LengthFloat] = sp_ftoc(info.duration);
+	fields[SoundInfo_BitRate] = info.bitRate;
+	fields[SoundInfo_SamplingRate] = info.samplingRate;
+	fields[SoundInfo_Channels] = info.channels;
+	fields[SoundInfo_Num] = info.num;
+	fields[SoundInfo_Year] = info.year;
+	fields[SoundInfo_LengthMs] = info.lengthMs;
+
+	cell_t *array;
+	int addrErr;
+	if ((addrErr=pContext->LocalToPhysAddr(params[2], &array)) != SP_ERROR_NONE) {
+		return pContext->ThrowNativeErrorEx(addrErr, NULL);
+	}
+
+	memcpy(array, fields, count * sizeof(cell_t));
+
+	return count;
+}
+
+static cell_t GetSoundTags(IPluginContext *pContext, const cell_t *params) {
+	Handle_t hndl = static_cast<Handle_t>(params[1]);
+	HandleError err;
+	HandleSecurity sec;
+ 
+	/* Build our security descriptor */
+	sec.pOwner = NULL;	/* Not needed, owner access is not checked */
+	sec.pIdentity = myself->GetIdentity();	/* But only this extension can read */
+ 
+	SoundFile *soundfile;
+	if ((err = g_pHandleSys->ReadHandle(hndl, g_SoundFileType, &sec, (void **)&soundfile))
+	     != HandleError_None)
+	{
+		return pContext->ThrowNativeError("Invalid sound-file handle %x (error %d)", hndl, err);
+	}
+
+	LoadSoundTags(soundfile);
+
+	const SoundInfo &info = soundfile->getInfo();
+	const std::string *tags[] = { &info.artist, &info.title, &info.album, &info.comment, &info.genre };
+
+	// Buffer/maxlength pairs follow the handle, a maxlength of 0 skips the tag
+	for (size_t i = 0; i < SIZEOFARRAY(tags); i++) {
+		CopySoundString(pContext, params[2 + i * 2], params[3 + i * 2], *tags[i]);
+	}
 
-	return pContext->StringToLocalUTF8(params[2], static_cast<size_t>(params[3]), str, NULL);
+	return 0;
 }
 
 /*bool SoundLibrary::SDK_OnMetamodLoad(ISmmAPI *ismm, char *error, size_t maxlen, bool late) {
@@ -295,7 +1027,56 @@ void SoundLibrary::SDK_OnAllLoaded() {
 }
 
 bool SoundLibrary::SDK_OnLoad(char *error, size_t maxlength, bool late) {
+	// TagLib creates these lazily, make sure this happens before any worker thread uses them
+	TagLib::ID3v2::FrameFactory::instance();
+	TagLib::ID3v1::genreList();
+	TagLib::ID3v1::genreMap();
+
+	// Only read the ID3v2 frames behind the tag natives, cover art and other large frames are skipped.
+	// Safe because the extension never saves tags.
+	static const char *frameIDs[] = { "TIT2", "TPE1", "TALB", "TRCK", "TDRC", "COMM", "TCON" };
+	TagLib::ByteVectorList frameFilter;
+
+	for (size_t i = 0; i < SIZEOFARRAY(frameIDs); i++) {
+		frameFilter.append(frameIDs[i]);
+	}
+
+	TagLib::ID3v2::FrameFactory::instance()->setFrameFilter(frameFilter);
+
+	unsigned int threads = SoundThreadPool::getProcessorCount() - 1;
+
+	if (threads < 1) {
+		threads = 1;
+	}
+	else if (threads > SOUNDPOOL_MAX_THREADS) {
+		threads = SOUNDPOOL_MAX_THREADS;
+	}
+
+	if (!g_SoundCache.init()) {
+		snprintf(error, maxlength, "Could not create the cache lock");
+		return false;
+	}
+
+	if (!g_SoundIndex.init()) {
+		snprintf(error, maxlength, "Could not create the index lock");
+		g_SoundCache.shutdown();
+		return false;
+	}
+
+	if (!g_SoundThreadPool.start(threads)) {
+		snprintf(error, maxlength, "Could not start the worker threads");
+		g_SoundThreadPool.stop();
+		g_SoundIndex.shutdown();
+		g_SoundCache.shutdown();
+		return false;
+	}
+
+	// Created last, nothing can fail after this
 	g_SoundFileType = g_pHandleSys->CreateType("SoundFile", &g_FileTypeHandler, 0, NULL, NULL, myself->GetIdentity(), NULL);
+	g_SoundScanType = g_pHandleSys->CreateType("SoundScan", &g_ScanTypeHandler, 0, NULL, NULL, myself->GetIdentity(), NULL);
+
+	smutils->AddGameFrameHook(&OnGameFrame);
+	rootconsole->AddRootConsoleCommand("soundlib", "Sound Info Library statistics", this);
 
 	sharesys->AddNatives(myself, g_SoundLibraryNatives);
 
@@ -303,6 +1084,13 @@ bool SoundLibrary::SDK_OnLoad(char *error, size_t maxlength, bool late) {
 }
 
 void SoundLibrary::SDK_OnUnload() {
+	rootconsole->RemoveRootConsoleCommand("soundlib", this);
+	smutils->RemoveGameFrameHook(&OnGameFrame);
+	g_SoundThreadPool.stop();
+	g_SoundCache.shutdown();
+	g_SoundIndex.shutdown();
+
+	g_pHandleSys->RemoveType(g_SoundScanType, myself->GetIdentity());
 	g_pHandleSys->RemoveType(g_SoundFileType, myself->GetIdentity());
 }
 
@@ -310,6 +1098,31 @@ bool SoundLibrary::QueryRunning(char *error, size_t maxlength) {
 	return true;
 }
 
+void SoundLibrary::OnRootConsoleCommand(const char *cmdname, const CCommand &command) {
+	SoundCacheStats cache;
+	g_SoundCache.getStats(&cache);
+
+	unsigned int lookups = cache.hits + cache.misses;
+
+	rootconsole->ConsolePrint("[SoundLib] Cache: %u entries, %u KiB", cache.entries, cache.bytes / 1024);
+	rootconsole->ConsolePrint("[SoundLib] Cache: %u hits, %u misses (%.1f%% hit rate), %u evictions",
+		cache.hits, cache.misses, lookups > 0 ? 100.0 * cache.hits / lookups : 0.0, cache.evictions);
+
+	SoundIndexStats index;
+	g_SoundIndex.getStats(&index);
+
+	rootconsole->ConsolePrint("[SoundLib] Index: %u entries, %u KiB, %u hits, %u misses, %u writes",
+		index.entries, index.bytes / 1024, index.hits, index.misses, index.writes);
+
+	SoundPoolStats pool;
+	g_SoundThreadPool.getStats(&pool);
+
+	rootconsole->ConsolePrint("[SoundLib] Workers: %u threads, %u queued, %u running, %u completed",
+		pool.threads, pool.queued, pool.running, pool.completed);
+	rootconsole->ConsolePrint("[SoundLib] Workers: %.1f ms average latency, %.1f ms max latency",
+		pool.avgLatency * 1000.0, pool.maxLatency * 1000.0);
+}
+
 
 void CListener::OnClientPutInServer(int client) {
 
@@ -322,10 +1135,21 @@ void CListener::OnClientDisconnecting(int client) {
 sp_nativeinfo_t g_SoundLibraryNatives[] = 
 {
 	{"OpenSoundFile",			OpenSoundFile},
+	{"OpenSoundFileAsync",		OpenSoundFileAsync},
+	{"ScanSoundDirectory",		ScanSoundDirectory},
+	{"GetSoundScanCount",		GetSoundScanCount},
+	{"GetSoundScanFile",		GetSoundScanFile},
+	{"GetSoundScanLength",		GetSoundScanLength},
+	{"OpenSoundScanFile",		OpenSoundScanFile},
+	{"GetSoundAsyncStats",		GetSoundAsyncStats},
+	{"GetSoundCacheStats",		GetSoundCacheStats},
 	{"GetSoundLength",			GetSoundLength},
 	{"GetSoundLengthFloat",		GetSoundLengthFloat},
+	{"GetSoundLengthMs",		GetSoundLengthMs},
 	{"GetSoundBitRate",			GetSoundBitRate},
 	{"GetSoundSamplingRate",	GetSoundSamplingRate},
+	{"GetSoundChannels",		GetSoundChannels},
+	{"GetSoundSampleCount",		GetSoundSampleCount},
 	{"GetSoundArtist",			GetSoundArtist},
 	{"GetSoundTitle",			GetSoundTitle},
 	{"GetSoundNum",				GetSoundNum},
@@ -333,5 +1157,7 @@ sp_nativeinfo_t g_SoundLibraryNatives[] =
 	{"GetSoundYear",			GetSoundYear},
 	{"GetSoundComment",			GetSoundComment},
 	{"GetSoundGenre",			GetSoundGenre},
+	{"GetSoundInfo",			GetSoundInfo},
+	{"GetSoundTags",			GetSoundTags},
 	{NULL,						NULL},
 };
@@ -5,7 +5,7 @@
 #include "smsdk_ext.h"
 
 
-class SoundLibrary : public SDKExtension
+class SoundLibrary : public SDKExtension, public IRootConsoleCommand
 {
 public:
 	/**
@@ -46,6 +46,12 @@ public:
 	void Hook_ImpulseCommands();
 	bool ImpulseCommands(int client, int impulse);
 
+public: //IRootConsoleCommand
+	/**
+	 * @brief Handles the "sm soundlib" server command.
+	 */
+	void OnRootConsoleCommand(const char *cmdname, const CCommand &command);
+
 public:
 #if defined SMEXT_CONF_METAMOD
 	/**
@@ -57,6 +57,7 @@ public:
 
   String::Type defaultEncoding;
   bool useDefaultEncoding;
+  ByteVectorList frameFilter;
 
   template <class T> void setTextEncoding(T *frame)
   {
@@ -255,6 +256,32 @@ void FrameFactory::setDefaultTextEncoding(String::Type encoding)
   d->defaultEncoding = encoding;
 }
 
+void FrameFactory::setFrameFilter(const ByteVectorList &frameIDs)
+{
+  d->frameFilter = frameIDs;
+}
+
+ByteVectorList FrameFactory::frameFilter() const
+{
+  return d->frameFilter;
+}
+
+bool FrameFactory::isWanted(const ByteVector &headerData, uint version) const
+{
+  if(d->frameFilter.isEmpty())
+    return true;
+
+  Frame::Header header(headerData, version);
+
+  // Frames that don't exist in ID3v2.4 are kept as unknown frames, which can't
+  // be on the list.
+
+  if(!updateFrame(&header))
+    return false;
+
+  return d->frameFilter.contains(header.frameID());
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // protected members
 ////////////////////////////////////////////////////////////////////////////////
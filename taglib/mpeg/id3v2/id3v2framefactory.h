@@ -28,6 +28,7 @@
 
 #include "taglib_export.h"
 #include "tbytevector.h"
+#include "tbytevectorlist.h"
 #include "id3v2frame.h"
 #include "id3v2header.h"
 
@@ -115,6 +116,39 @@ namespace TagLib {
        */
       void setDefaultTextEncoding(String::Type encoding);
 
+      /*!
+       * Limits the frames that are read from files to \a frameIDs, given as
+       * ID3v2.4 frame IDs.  ID3v2.2 and ID3v2.3 frames are matched after they
+       * have been converted to ID3v2.4.  All other frames are skipped without
+       * being read, which keeps large binary frames like attached pictures out
+       * of memory when only a few text fields are needed.
+       *
+       * An empty list, the default, reads all frames.
+       *
+       * \warning Tags read with a frame filter are incomplete.  Saving them
+       * drops the frames that were skipped.
+       *
+       * \see frameFilter()
+       */
+      void setFrameFilter(const ByteVectorList &frameIDs);
+
+      /*!
+       * Returns the frame IDs that are read from files, or an empty list if
+       * all frames are read.
+       *
+       * \see setFrameFilter()
+       */
+      ByteVectorList frameFilter() const;
+
+      /*!
+       * Returns true if the frame starting with the header in \a headerData
+       * should be read according to the frame filter.  \a version is the
+       * ID3v2 version of the tag.
+       *
+       * \see setFrameFilter()
+       */
+      bool isWanted(const ByteVector &headerData, uint version) const;
+
     protected:
       /*!
        * Constructs a frame factory.  Because this is a singleton this method is
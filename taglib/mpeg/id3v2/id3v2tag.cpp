@@ -40,6 +40,35 @@
 using namespace TagLib;
 using namespace ID3v2;
 
+namespace
+{
+  // The frame ID checks of FrameFactory::createFrame() and Frame::Header
+
+  bool isValidFrameID(const ByteVector &frameID, uint size = 4)
+  {
+    if(frameID.size() != size)
+      return false;
+
+    for(ByteVector::ConstIterator it = frameID.begin(); it != frameID.end(); it++) {
+      if( (*it < 'A' || *it > 'Z') && (*it < '1' || *it > '9') ) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Reads the four bytes at position, or nothing if they are not part of the tag
+
+  ByteVector readFrameID(File *file, long position, long end)
+  {
+    if(position < 0 || position + 4 > end)
+      return ByteVector::null;
+
+    file->seek(position);
+    return file->readBlock(4);
+  }
+}
+
 class ID3v2::Tag::TagPrivate
 {
 public:
@@ -388,7 +417,111 @@ void ID3v2::Tag::read()
     if(d->header.tagSize() == 0)
       return;
 
-    parse(d->file->readBlock(d->header.tagSize()));
+    // With a frame filter only the wanted frames are read.  Tags that are
+    // unsynchronised as a whole have to be decoded before the frames can be
+    // found, so those are still read in one go.
+
+    if(!d->factory->frameFilter().isEmpty() &&
+       !(d->header.unsynchronisation() && d->header.majorVersion() <= 3))
+    {
+      readFrames();
+    }
+    else
+      parse(d->file->readBlock(d->header.tagSize()));
+  }
+}
+
+void ID3v2::Tag::readFrames()
+{
+  const uint version = d->header.majorVersion();
+  const uint frameHeaderSize = Frame::headerSize(version);
+
+  // This follows parse(), but reads the frame headers one by one and seeks
+  // over the frames that the frame factory doesn't want.
+
+  const long tagEnd = d->tagOffset + Header::size() + d->header.tagSize();
+
+  long position = d->tagOffset + Header::size();
+  long end = tagEnd;
+
+  if(d->header.extendedHeader()) {
+    if(!d->extendedHeader)
+      d->extendedHeader = new ExtendedHeader;
+    d->file->seek(position);
+    d->extendedHeader->setData(d->file->readBlock(4));
+    if(d->extendedHeader->size() <= d->header.tagSize())
+      position += d->extendedHeader->size();
+  }
+
+  if(d->header.footerPresent() && long(Footer::size()) <= end - position)
+    end -= Footer::size();
+
+  while(position + long(frameHeaderSize) < end) {
+
+    d->file->seek(position);
+    const ByteVector headerData = d->file->readBlock(frameHeaderSize);
+
+    if(headerData.size() < frameHeaderSize)
+      return;
+
+    if(headerData[0] == 0) {
+      if(d->header.footerPresent())
+        debug("Padding *and* a footer found.  This is not allowed by the spec.");
+
+      d->paddingSize = end - position;
+      return;
+    }
+
+    Frame::Header header(headerData, version);
+    uint frameSize = header.frameSize();
+
+#ifndef NO_ITUNES_HACKS
+    // Frame::Header tells iTunes' non-synchsafe frame sizes apart by looking
+    // for the next frame ID, which isn't part of headerData.
+
+    if(version == 4 && frameSize > 127) {
+      const long frameData = position + frameHeaderSize;
+      if(!isValidFrameID(readFrameID(d->file, frameData + frameSize, tagEnd))) {
+        const uint uintSize = headerData.mid(4, 4).toUInt();
+        if(isValidFrameID(readFrameID(d->file, frameData + uintSize, tagEnd)))
+          frameSize = uintSize;
+      }
+    }
+#endif
+
+    // Stop where createFrame() would have failed.
+
+    if(frameSize <= uint(header.dataLengthIndicator() ? 4 : 0) ||
+       frameSize > uint(tagEnd - position) ||
+       !isValidFrameID(header.frameID(), version < 3 ? 3 : 4))
+    {
+      return;
+    }
+
+    if(d->factory->isWanted(headerData, version)) {
+
+      // The next frame ID is read along with the frame for the same reason
+      // as above.
+
+      const long size = frameHeaderSize + frameSize + 4;
+
+      d->file->seek(position);
+      Frame *frame = d->factory->createFrame(d->file->readBlock(size < tagEnd - position ? size : tagEnd - position),
+                                             &d->header);
+
+      if(!frame)
+        return;
+
+      if(frame->size() <= 0) {
+        delete frame;
+        return;
+      }
+
+      frameSize = frame->size();
+      addFrame(frame);
+    }
+
+    position += frameHeaderSize + frameSize;
   }
 }
 
@@ -421,7 +554,9 @@ void ID3v2::Tag::parse(const ByteVector &origData)
   if(d->header.footerPresent() && Footer::size() <= frameDataLength)
     frameDataLength -= Footer::size();
 
-  // parse frames
+  // parse frames, keeping only the ones passing the frame factory's filter
+
+  const ByteVectorList frameFilter = d->factory->frameFilter();
 
   // Make sure that there is at least enough room in the remaining frame data for
   // a frame header.
@@ -453,7 +588,11 @@ void ID3v2::Tag::parse(const ByteVector &origData)
     }
 
     frameDataPosition += frame->size() + Frame::headerSize(d->header.majorVersion());
-    addFrame(frame);
+
+    if(frameFilter.isEmpty() || frameFilter.contains(frame->frameID()))
+      addFrame(frame);
+    else
+      delete frame;
   }
 }
 
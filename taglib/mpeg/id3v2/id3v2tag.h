@@ -280,6 +280,15 @@ namespace TagLib {
        */
       void parse(const ByteVector &data);
 
+      /*!
+       * This is called by read instead of parse if the frame factory has a
+       * frame filter.  It reads the frame headers one at a time and skips the
+       * frames that are not wanted without reading them.
+       *
+       * \see FrameFactory::setFrameFilter()
+       */
+      void readFrames();
+
       /*!
        * Sets the value of the text frame with the Frame ID \a id to \a value.
        * If the frame does not exist, it is created.
@@ -30,8 +30,10 @@
 #include <apefooter.h>
 #include <apetag.h>
 #include <tdebug.h>
+#include <tsimd.h>
 
 #include <bitset>
+#include <string.h>
 
 #include "mpegfile.h"
 #include "mpegheader.h"
@@ -41,6 +43,109 @@ using namespace TagLib;
 namespace
 {
   enum { ID3v2Index = 0, APEIndex = 1, ID3v1Index = 2 };
+
+  inline bool isSynch(const char *p)
+  {
+    return uchar(p[0]) == 0xff && uchar(p[1]) != 0xff && (uchar(p[1]) & 0xe0) == 0xe0;
+  }
+
+  // Returns the first frame synch (11111111 111xxxxx) that starts in
+  // [data, end - 1), or a null pointer.
+
+  const char *findSynch(const char *data, const char *end)
+  {
+    const char *p = data;
+
+#ifdef TAGLIB_SSE2
+    const __m128i ff = _mm_set1_epi8(char(0xff));
+    const __m128i e0 = _mm_set1_epi8(char(0xe0));
+
+    while(end - p > 16) {
+      const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+      const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1));
+      const __m128i second = _mm_andnot_si128(_mm_cmpeq_epi8(b, ff),
+                                              _mm_cmpeq_epi8(_mm_and_si128(b, e0), e0));
+      int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, ff), second));
+      if(mask) {
+        int i = 0;
+        while(!(mask & (1 << i)))
+          i++;
+        return p + i;
+      }
+      p += 16;
+    }
+#endif
+
+    while(p < end - 1) {
+      p = static_cast<const char *>(::memchr(p, 0xff, end - 1 - p));
+
+      if(!p)
+        return 0;
+
+      if(isSynch(p))
+        return p;
+
+      p++;
+    }
+
+    return 0;
+  }
+
+  // Returns the last frame synch that starts in [data, end - 1).
+
+  const char *rfindSynch(const char *data, const char *end)
+  {
+    const char *p = end - 1;
+
+#ifdef TAGLIB_SSE2
+    const __m128i ff = _mm_set1_epi8(char(0xff));
+    const __m128i e0 = _mm_set1_epi8(char(0xe0));
+
+    while(p - data >= 16) {
+      p -= 16;
+      const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+      const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1));
+      const __m128i second = _mm_andnot_si128(_mm_cmpeq_epi8(b, ff),
+                                              _mm_cmpeq_epi8(_mm_and_si128(b, e0), e0));
+      int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, ff), second));
+      if(mask) {
+        int i = 15;
+        while(!(mask & (1 << i)))
+          i--;
+        return p + i;
+      }
+    }
+#endif
+
+    while(p > data) {
+      p--;
+      if(isSynch(p))
+        return p;
+    }
+
+    return 0;
+  }
+
+  // Rejects synchs with reserved header fields without going through
+  // MPEG::Header, which would complain about every one of them.
+
+  inline bool isFrameHeader(const ByteVector &data)
+  {
+    if(data.size() < 4 || !isSynch(data.data()))
+      return false;
+
+    const uchar b = uchar(data[1]);
+    const uchar c = uchar(data[2]);
+
+    return (b & 0x18) != 0x08 && (b & 0x06) != 0 && (c & 0xf0) != 0xf0 && (c & 0x0c) != 0x0c;
+  }
+
+  // Opening a file reads both of its ends: the ID3v2 tag and the first frames
+  // at the start, the ID3v1 and APE tags and the last frames at the end.  Each
+  // end is read once and the probes are served from memory, see readWindows().
+
+  const uint headWindowSize = 8192;
+  const uint tailWindowSize = 4096;
 }
 
 class MPEG::File::FilePrivate
@@ -57,6 +162,9 @@ public:
     hasID3v2(false),
     hasID3v1(false),
     hasAPE(false),
+    tagsRead(false),
+    headOffset(0),
+    tailOffset(0),
     properties(0)
   {
 
@@ -87,6 +195,18 @@ public:
   bool hasID3v1;
   bool hasAPE;
 
+  // False until readTags() has been called, tag() is empty until then.
+
+  bool tagsRead;
+
+  // Copies of the start and the end of the file, only kept while it's being
+  // read.
+
+  ByteVector head;
+  long headOffset;
+  ByteVector tail;
+  long tailOffset;
+
   Properties *properties;
 };
 
@@ -113,6 +233,17 @@ MPEG::File::File(FileName file, ID3v2::FrameFactory *frameFactory,
     read(readProperties, propertiesStyle);
 }
 
+MPEG::File::File(FileName file, ID3v2::FrameFactory *frameFactory,
+                 bool readProperties, Properties::ReadStyle propertiesStyle,
+                 bool readTags, bool memoryMap) :
+  TagLib::File(file, memoryMap)
+{
+  d = new FilePrivate(frameFactory);
+
+  if(isOpen())
+    read(readProperties, propertiesStyle, readTags);
+}
+
 MPEG::File::~File()
 {
   delete d;
@@ -140,6 +271,11 @@ bool MPEG::File::save(int tags)
 
 bool MPEG::File::save(int tags, bool stripOthers)
 {
+  if(!d->tagsRead) {
+    debug("MPEG::File::save() -- The tags have not been read.");
+    return false;
+  }
+
   if(tags == NoTags && stripOthers)
     return strip(AllTags);
 
@@ -319,122 +455,357 @@ void MPEG::File::setID3v2FrameFactory(const ID3v2::FrameFactory *factory)
 
 long MPEG::File::nextFrameOffset(long position)
 {
-  bool foundLastSyncPattern = false;
+  if(position < 0)
+    return -1;
+
+  const long fileLength = length();
+
+  // Scan memory mapped files in place.
 
+  ulong available;
+  const char *data = mappedData(position, &available);
+
+  if(data) {
+    const char *end = data + available;
+
+    for(const char *p = findSynch(data, end); p; p = findSynch(p + 1, end)) {
+      if(isFrame(position + (p - data), fileLength))
+        return position + (p - data);
+    }
+
+    return -1;
+  }
+
+  // While the file is being opened the first frame is usually in the head
+  // window.  Carry on behind it if it isn't.
+
+  long windowOffset;
+  const ByteVector *window = windowAt(position, &windowOffset);
+
+  if(window) {
+    const char *begin = window->data();
+    const char *end = begin + window->size();
+
+    for(const char *p = findSynch(begin + (position - windowOffset), end); p; p = findSynch(p + 1, end)) {
+      if(isFrame(windowOffset + (p - begin), fileLength))
+        return windowOffset + (p - begin);
+    }
+
+    if(windowOffset + long(window->size()) >= fileLength)
+      return -1;
+
+    position = windowOffset + window->size() - 1;
+  }
+
+  // Otherwise read in growing blocks, most files have their first frame right
+  // at the start.  Each block overlaps the next by one byte, so that a synch
+  // split between them is still found.
+
+  uint blockSize = bufferSize();
   ByteVector buffer;
 
   while(true) {
     seek(position);
-    buffer = readBlock(bufferSize());
+    buffer = readBlock(blockSize);
 
-    if(buffer.size() <= 0)
+    if(buffer.size() < 2)
       return -1;
 
-    if(foundLastSyncPattern && secondSynchByte(buffer[0]))
-      return position - 1;
+    const char *begin = buffer.data();
+    const char *end = begin + buffer.size();
 
-    for(uint i = 0; i < buffer.size() - 1; i++) {
-      if(uchar(buffer[i]) == 0xff && secondSynchByte(buffer[i + 1]))
-        return position + i;
+    for(const char *p = findSynch(begin, end); p; p = findSynch(p + 1, end)) {
+      if(isFrame(position + (p - begin), fileLength))
+        return position + (p - begin);
     }
 
-    foundLastSyncPattern = uchar(buffer[buffer.size() - 1]) == 0xff;
-    position += buffer.size();
+    position += buffer.size() - 1;
+
+    if(blockSize < searchBufferSize())
+      blockSize *= 2;
   }
 }
 
 long MPEG::File::previousFrameOffset(long position)
 {
-  bool foundFirstSyncPattern = false;
+  if(position <= 0)
+    return -1;
+
+  // Scan memory mapped files in place.
+
+  ulong available;
+  const char *data = mappedData(0, &available);
+
+  if(data) {
+    if(ulong(position) < available)
+      available = position;
+
+    for(const char *p = rfindSynch(data, data + available); p; p = rfindSynch(data, p + 1)) {
+      if(isFrame(p - data, position))
+        return p - data;
+    }
+
+    return -1;
+  }
+
+  const long limit = position;
+  long end = position;
+
+  // Likewise the last frame is usually in the tail window.
+
+  long windowOffset;
+  const ByteVector *window = windowAt(position - 1, &windowOffset);
+
+  if(window) {
+    const char *begin = window->data();
+
+    for(const char *p = rfindSynch(begin, begin + (position - windowOffset)); p; p = rfindSynch(begin, p + 1)) {
+      if(isFrame(windowOffset + (p - begin), limit))
+        return windowOffset + (p - begin);
+    }
+
+    if(windowOffset == 0)
+      return -1;
+
+    end = windowOffset + 1;
+  }
+
+  uint blockSize = bufferSize();
   ByteVector buffer;
 
-  while (position > 0) {
-    long size = ulong(position) < bufferSize() ? position : bufferSize();
-    position -= size;
+  // As in nextFrameOffset() the blocks overlap by one byte.
 
-    seek(position);
-    buffer = readBlock(size);
+  while(end > 1) {
+    long start = end > long(blockSize) ? end - blockSize : 0;
 
-    if(buffer.size() <= 0)
+    seek(start);
+    buffer = readBlock(end - start);
+
+    if(buffer.size() < 2)
       break;
 
-    if(foundFirstSyncPattern && uchar(buffer[buffer.size() - 1]) == 0xff)
-      return position + buffer.size() - 1;
+    const char *begin = buffer.data();
 
-    for(int i = buffer.size() - 2; i >= 0; i--) {
-      if(uchar(buffer[i]) == 0xff && secondSynchByte(buffer[i + 1]))
-        return position + i;
+    for(const char *p = rfindSynch(begin, begin + buffer.size()); p; p = rfindSynch(begin, p + 1)) {
+      if(isFrame(start + (p - begin), limit))
+        return start + (p - begin);
     }
 
-    foundFirstSyncPattern = secondSynchByte(buffer[0]);
+    end = start + 1;
+
+    if(blockSize < searchBufferSize())
+      blockSize *= 2;
   }
+
   return -1;
 }
 
+void MPEG::File::readTags()
+{
+  if(d->tagsRead)
+    return;
+
+  d->tagsRead = true;
+
+  if(d->hasID3v2)
+    d->tag.set(ID3v2Index, new ID3v2::Tag(this, d->ID3v2Location, d->ID3v2FrameFactory));
+
+  if(d->hasID3v1)
+    d->tag.set(ID3v1Index, new ID3v1::Tag(this, d->ID3v1Location));
+
+  // Look for an APE tag
+
+  findAPE();
+
+  if(d->APELocation >= 0) {
+
+    d->tag.set(APEIndex, new APE::Tag(this, d->APEFooterLocation));
+    d->APEOriginalSize = APETag()->footer()->completeTagSize();
+    d->hasAPE = true;
+  }
+
+  // Make sure that we have our default tag types available.
+
+  ID3v2Tag(true);
+  ID3v1Tag(true);
+}
+
 long MPEG::File::firstFrameOffset()
 {
   long position = 0;
 
-  if(ID3v2Tag())
+  // The ID3v2 tag always exists after reading the file, but only counts if it
+  // is on disk.  Without parsed tags only its size from the header is known.
+
+  if(d->hasID3v2 && ID3v2Tag())
     position = d->ID3v2Location + ID3v2Tag()->header()->completeTagSize();
+  else if(d->hasID3v2)
+    position = d->ID3v2Location + d->ID3v2OriginalSize;
 
   return nextFrameOffset(position);
 }
 
 long MPEG::File::lastFrameOffset()
 {
-  return previousFrameOffset(ID3v1Tag() ? d->ID3v1Location - 1 : length());
+  return previousFrameOffset(ID3v1Tag() || d->hasID3v1 ? d->ID3v1Location - 1 : length());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 // private members
 ////////////////////////////////////////////////////////////////////////////////
 
-void MPEG::File::read(bool readProperties, Properties::ReadStyle propertiesStyle)
+void MPEG::File::read(bool readProperties, Properties::ReadStyle propertiesStyle,
+                      bool parseTags)
 {
-  // Look for an ID3v2 tag
+  readWindows();
+
+  // Look for an ID3v2 tag.  Only its header is needed to find the start of the
+  // audio data, the frames are parsed by readTags().
 
   d->ID3v2Location = findID3v2();
 
   if(d->ID3v2Location >= 0) {
+    ID3v2::Header header(readAt(d->ID3v2Location, ID3v2::Header::size()));
 
-    d->tag.set(ID3v2Index, new ID3v2::Tag(this, d->ID3v2Location, d->ID3v2FrameFactory));
+    d->ID3v2OriginalSize = header.completeTagSize();
+    d->hasID3v2 = header.tagSize() > 0;
 
-    d->ID3v2OriginalSize = ID3v2Tag()->header()->completeTagSize();
+    // Large tags, mostly because of cover art, push the first frame out of
+    // the head window.  Read it again from the end of the tag.
 
-    if(ID3v2Tag()->header()->tagSize() <= 0)
-      d->tag.set(ID3v2Index, 0);
-    else
-      d->hasID3v2 = true;
+    const long audioOffset = d->ID3v2Location + d->ID3v2OriginalSize;
+
+    if(!d->head.isEmpty() && audioOffset + long(headWindowSize / 2) > d->headOffset + long(d->head.size()) &&
+       audioOffset < long(length()))
+    {
+      d->headOffset = audioOffset & ~long(4095);
+      seek(d->headOffset);
+      d->head = readBlock(headWindowSize);
+    }
   }
 
   // Look for an ID3v1 tag
 
   d->ID3v1Location = findID3v1();
+  d->hasID3v1 = d->ID3v1Location >= 0;
 
-  if(d->ID3v1Location >= 0) {
-    d->tag.set(ID3v1Index, new ID3v1::Tag(this, d->ID3v1Location));
-    d->hasID3v1 = true;
+  if(readProperties)
+    d->properties = new Properties(this, propertiesStyle);
+
+  if(parseTags)
+    readTags();
+
+  d->head = ByteVector();
+  d->tail = ByteVector();
+}
+
+void MPEG::File::readWindows()
+{
+  // Memory mapped files are read in place anyway.
+
+  ulong available;
+
+  if(!isValid() || mappedData(0, &available))
+    return;
+
+  const long fileLength = length();
+
+  seek(0);
+  d->head = readBlock(headWindowSize);
+  d->headOffset = 0;
+
+  if(fileLength > long(d->head.size())) {
+    // Start on a block boundary, stdio reads up to it otherwise.
+
+    d->tailOffset = (fileLength - long(tailWindowSize)) & ~long(4095);
+
+    if(d->tailOffset < long(d->head.size()))
+      d->tailOffset = d->head.size();
+
+    seek(d->tailOffset);
+    d->tail = readBlock(fileLength - d->tailOffset);
   }
+}
 
-  // Look for an APE tag
+const ByteVector *MPEG::File::windowAt(long offset, long *windowOffset) const
+{
+  if(offset >= d->headOffset && offset - d->headOffset < long(d->head.size())) {
+    *windowOffset = d->headOffset;
+    return &d->head;
+  }
 
-  findAPE();
+  if(offset >= d->tailOffset && offset - d->tailOffset < long(d->tail.size())) {
+    *windowOffset = d->tailOffset;
+    return &d->tail;
+  }
 
-  if(d->APELocation >= 0) {
+  return 0;
+}
 
-    d->tag.set(APEIndex, new APE::Tag(this, d->APEFooterLocation));
-    d->APEOriginalSize = APETag()->footer()->completeTagSize();
-    d->hasAPE = true;
+ByteVector MPEG::File::readAt(long offset, ulong length)
+{
+  long windowOffset;
+  const ByteVector *window = windowAt(offset, &windowOffset);
+
+  if(window) {
+    const ulong available = window->size() - (offset - windowOffset);
+
+    // A window can only come up short at the end of the file.
+
+    if(length <= available)
+      return ByteVector(window->data() + (offset - windowOffset), length);
+
+    if(windowOffset + long(window->size()) >= long(File::length()))
+      return ByteVector(window->data() + (offset - windowOffset), available);
   }
 
-  if(readProperties)
-    d->properties = new Properties(this, propertiesStyle);
+  seek(offset);
+  return readBlock(length);
+}
 
-  // Make sure that we have our default tag types available.
+// Junk and cover art are full of byte pairs that look like a synch.  A real
+// frame is followed by another frame with the same version, layer and sample
+// rate, or by the end of the stream or a tag.  Frames that reach past limit
+// can't be checked and are taken as they are.
 
-  ID3v2Tag(true);
-  ID3v1Tag(true);
+bool MPEG::File::isFrame(long offset, long limit)
+{
+  const ByteVector data = readAt(offset, 4);
+
+  if(!isFrameHeader(data))
+    return false;
+
+  const Header header(data);
+
+  if(!header.isValid())
+    return false;
+
+  // Free format frames have no length to check against, and nothing can be
+  // calculated from them anyway.
+
+  if(header.bitrate() == 0)
+    return false;
+
+  const long next = offset + header.frameLength();
+
+  if(next + 4 > limit)
+    return true;
+
+  const ByteVector nextData = readAt(next, 4);
+
+  if(nextData.startsWith("TAG") || nextData.startsWith("APET") ||
+     nextData.startsWith("LYRI") || nextData.startsWith("ID3"))
+    return true;
+
+  if(!isFrameHeader(nextData))
+    return false;
+
+  const Header nextHeader(nextData);
+
+  return nextHeader.isValid() &&
+    nextHeader.version() == header.version() &&
+    nextHeader.layer() == header.layer() &&
+    nextHeader.sampleRate() == header.sampleRate();
 }
 
 long MPEG::File::findID3v2()
@@ -456,14 +827,8 @@ long MPEG::File::findID3v2()
     int previousPartialMatch = -1;
     bool previousPartialSynchMatch = false;
 
-    // Save the location of the current read pointer.  We will restore the
-    // position using seek() before all returns.
-
-    long originalPosition = tell();
-
-    // Start the search at the beginning of the file.
-
-    seek(0);
+    // Start the search at the beginning of the file.  The reads are served
+    // from the head window while the file is being opened.
 
     // This loop is the crux of the find method.  There are three cases that we
     // want to account for:
@@ -477,7 +842,7 @@ long MPEG::File::findID3v2()
     // note this for use in the next itteration, where we will check for the rest
     // of the pattern.
 
-    for(buffer = readBlock(bufferSize()); buffer.size() > 0; buffer = readBlock(bufferSize())) {
+    for(buffer = readAt(0, bufferSize()); buffer.size() > 0; buffer = readAt(bufferOffset, bufferSize())) {
 
       // (1) previous partial match
 
@@ -487,7 +852,6 @@ long MPEG::File::findID3v2()
       if(previousPartialMatch >= 0 && int(bufferSize()) > previousPartialMatch) {
         const int patternOffset = (bufferSize() - previousPartialMatch);
         if(buffer.containsAt(ID3v2::Header::fileIdentifier(), 0, patternOffset)) {
-          seek(originalPosition);
           return bufferOffset - bufferSize() + previousPartialMatch;
         }
       }
@@ -496,53 +860,28 @@ long MPEG::File::findID3v2()
 
       long location = buffer.find(ID3v2::Header::fileIdentifier());
       if(location >= 0) {
-        seek(originalPosition);
         return bufferOffset + location;
       }
 
-      int firstSynchByte = buffer.find(char(uchar(255)));
-
-      // Here we have to loop because there could be several of the first
-      // (11111111) byte, and we want to check all such instances until we find
-      // a full match (11111111 111) or hit the end of the buffer.
+      // The tag has to come before the first frame synch.
 
-      while(firstSynchByte >= 0) {
-
-        // if this *is not* at the end of the buffer
-
-        if(firstSynchByte < int(buffer.size()) - 1) {
-          if(secondSynchByte(buffer[firstSynchByte + 1])) {
-            // We've found the frame synch pattern.
-            seek(originalPosition);
-            return -1;
-          }
-          else {
-
-            // We found 11111111 at the end of the current buffer indicating a
-            // partial match of the synch pattern.  The find() below should
-            // return -1 and break out of the loop.
-
-            previousPartialSynchMatch = true;
-          }
-        }
-
-        // Check in the rest of the buffer.
-
-        firstSynchByte = buffer.find(char(uchar(255)), firstSynchByte + 1);
+      if(findSynch(buffer.data(), buffer.data() + buffer.size())) {
+        return -1;
       }
 
+      previousPartialSynchMatch = uchar(buffer[buffer.size() - 1]) == 0xff;
+
       // (3) partial match
 
       previousPartialMatch = buffer.endsWithPartialMatch(ID3v2::Header::fileIdentifier());
 
-      bufferOffset += bufferSize();
+      bufferOffset += buffer.size();
     }
 
     // Since we hit the end of the file, reset the status before continuing.
 
     clear();
 
-    seek(originalPosition);
   }
 
   return -1;
@@ -550,11 +889,10 @@ long MPEG::File::findID3v2()
 
 long MPEG::File::findID3v1()
 {
-  if(isValid()) {
-    seek(-128, End);
-    long p = tell();
+  if(isValid() && length() >= 128) {
+    long p = long(length()) - 128;
 
-    if(readBlock(3) == ID3v1::Tag::fileIdentifier())
+    if(readAt(p, 3) == ID3v1::Tag::fileIdentifier())
       return p;
   }
   return -1;
@@ -563,14 +901,11 @@ long MPEG::File::findID3v1()
 void MPEG::File::findAPE()
 {
   if(isValid()) {
-    seek(d->hasID3v1 ? -160 : -32, End);
-
-    long p = tell();
+    long p = long(length()) - (d->hasID3v1 ? 160 : 32);
 
-    if(readBlock(8) == APE::Tag::fileIdentifier()) {
+    if(p >= 0 && readAt(p, 8) == APE::Tag::fileIdentifier()) {
       d->APEFooterLocation = p;
-      seek(d->APEFooterLocation);
-      APE::Footer footer(readBlock(APE::Footer::size()));
+      APE::Footer footer(readAt(d->APEFooterLocation, APE::Footer::size()));
       d->APELocation = d->APEFooterLocation - footer.completeTagSize()
 	+ APE::Footer::size();
       return;
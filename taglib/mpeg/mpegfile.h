@@ -91,6 +91,18 @@ namespace TagLib {
            bool readProperties = true,
            Properties::ReadStyle propertiesStyle = Properties::Average);
 
+      /*!
+       * Contructs an MPEG file from \a file.  If \a readTags is false only the
+       * positions and sizes of the ID3v2 and ID3v1 tags are read, which is all
+       * the audio properties need.  tag() is empty and the file can't be saved
+       * until readTags() is called.  If \a memoryMap is true the file is read
+       * through a memory mapping.
+       */
+      // BIC: merge with the above constructors
+      File(FileName file, ID3v2::FrameFactory *frameFactory,
+           bool readProperties, Properties::ReadStyle propertiesStyle,
+           bool readTags, bool memoryMap = false);
+
       /*!
        * Destroys this instance of the File.
        */
@@ -230,6 +242,12 @@ namespace TagLib {
        */
       void setID3v2FrameFactory(const ID3v2::FrameFactory *factory);
 
+      /*!
+       * Parses the tags of a file that was opened with \a readTags set to
+       * false.  Does nothing if they have been read already.
+       */
+      void readTags();
+
       /*!
        * Returns the position in the file of the first MPEG frame.
        */
@@ -256,7 +274,18 @@ namespace TagLib {
       File(const File &);
       File &operator=(const File &);
 
-      void read(bool readProperties, Properties::ReadStyle propertiesStyle);
+      void read(bool readProperties, Properties::ReadStyle propertiesStyle,
+                bool parseTags = true);
+
+      /*!
+       * Reads the start and the end of the file into memory.  Until read()
+       * is done, readAt() serves reads from there instead of the file.
+       */
+      void readWindows();
+      const ByteVector *windowAt(long offset, long *windowOffset) const;
+      ByteVector readAt(long offset, ulong length);
+      bool isFrame(long offset, long limit);
+
       long findID3v2();
       long findID3v1();
       void findAPE();
@@ -268,6 +297,8 @@ namespace TagLib {
        */
       static bool secondSynchByte(char byte);
 
+      friend class Properties;
+
       class FilePrivate;
       FilePrivate *d;
     };
@@ -185,6 +185,10 @@ void MPEG::Header::parse(const ByteVector &data)
     d->version = Version2;
   else if(flags[20] && flags[19])
     d->version = Version1;
+  else {
+    debug("MPEG::Header::parse() -- Reserved MPEG version.");
+    return;
+  }
 
   // Set the MPEG layer
 
@@ -194,6 +198,10 @@ void MPEG::Header::parse(const ByteVector &data)
     d->layer = 2;
   else if(flags[18] && flags[17])
     d->layer = 1;
+  else {
+    debug("MPEG::Header::parse() -- Reserved MPEG layer.");
+    return;
+  }
 
   d->protectionEnabled = !flags[16];
 
@@ -220,6 +228,11 @@ void MPEG::Header::parse(const ByteVector &data)
 
   int i = uchar(data[2]) >> 4;
 
+  if(i == 15) {
+    debug("MPEG::Header::parse() -- Invalid bitrate.");
+    return;
+  }
+
   d->bitrate = bitrates[versionIndex][layerIndex][i];
 
   // Set the sample rate
@@ -252,12 +265,15 @@ void MPEG::Header::parse(const ByteVector &data)
   d->isCopyrighted = flags[3];
   d->isPadded = flags[9];
 
-  // Calculate the frame length
+  // Calculate the frame length.  Layer I frames are counted in 4 byte slots,
+  // MPEG 2 and 2.5 layer III frames only hold half as many samples.
 
   if(d->layer == 1)
-    d->frameLength = 24000 * 2 * d->bitrate / d->sampleRate + int(d->isPadded);
-  else
+    d->frameLength = (12000 * d->bitrate / d->sampleRate + int(d->isPadded)) * 4;
+  else if(d->layer == 3 && d->version != Version1)
     d->frameLength = 72000 * d->bitrate / d->sampleRate + int(d->isPadded);
+  else
+    d->frameLength = 144000 * d->bitrate / d->sampleRate + int(d->isPadded);
 
   // Samples per frame
 
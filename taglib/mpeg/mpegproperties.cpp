@@ -26,18 +26,30 @@
 #include <tdebug.h>
 #include <tstring.h>
 
+#include <vector>
+
 #include "mpegproperties.h"
 #include "mpegfile.h"
 #include "xingheader.h"
+#include "vbriheader.h"
 
 using namespace TagLib;
 
+namespace
+{
+  // The seek table holds the offset of every 32nd frame, which is less than a
+  // second for all sample rates.
+
+  const uint seekTableInterval = 32;
+}
+
 class MPEG::Properties::PropertiesPrivate
 {
 public:
   PropertiesPrivate(File *f, ReadStyle s) :
     file(f),
     xingHeader(0),
+    vbriHeader(0),
     style(s),
     length(0),
     bitrate(0),
@@ -48,15 +60,22 @@ public:
     channelMode(Header::Stereo),
     protectionEnabled(false),
     isCopyrighted(false),
-    isOriginal(false) {}
+    isOriginal(false),
+    frameCount(0),
+    sampleCount(0),
+    streamLength(0),
+    samplesPerFrame(0),
+    seekInterval(0) {}
 
   ~PropertiesPrivate()
   {
     delete xingHeader;
+    delete vbriHeader;
   }
 
   File *file;
   XingHeader *xingHeader;
+  VBRIHeader *vbriHeader;
   ReadStyle style;
   int length;
   int bitrate;
@@ -68,6 +87,12 @@ public:
   bool protectionEnabled;
   bool isCopyrighted;
   bool isOriginal;
+  uint frameCount;
+  ulong sampleCount;
+  ulong streamLength;
+  int samplesPerFrame;
+  uint seekInterval;
+  std::vector<long> seekTable;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -107,11 +132,45 @@ int MPEG::Properties::channels() const
   return d->channels;
 }
 
+TagLib::uint MPEG::Properties::frameCount() const
+{
+  return d->frameCount;
+}
+
+TagLib::ulong MPEG::Properties::sampleCount() const
+{
+  return d->sampleCount;
+}
+
+TagLib::ulong MPEG::Properties::streamLength() const
+{
+  return d->streamLength;
+}
+
+long MPEG::Properties::seekOffset(int milliseconds) const
+{
+  if(d->seekTable.empty() || milliseconds < 0 || d->samplesPerFrame <= 0 || d->seekInterval == 0)
+    return -1;
+
+  const double frame = double(milliseconds) * d->sampleRate / 1000 / d->samplesPerFrame;
+  const double entry = frame / d->seekInterval;
+
+  if(entry >= d->seekTable.size())
+    return d->seekTable.back();
+
+  return d->seekTable[size_t(entry)];
+}
+
 const MPEG::XingHeader *MPEG::Properties::xingHeader() const
 {
   return d->xingHeader;
 }
 
+const MPEG::VBRIHeader *MPEG::Properties::vbriHeader() const
+{
+  return d->vbriHeader;
+}
+
 MPEG::Header::Version MPEG::Properties::version() const
 {
   return d->version;
@@ -158,8 +217,7 @@ void MPEG::Properties::read()
     return;
   }
 
-  d->file->seek(last);
-  Header lastHeader(d->file->readBlock(4));
+  Header lastHeader(d->file->readAt(last, 4));
 
   long first = d->file->firstFrameOffset();
 
@@ -179,8 +237,7 @@ void MPEG::Properties::read()
       if(pos < 0)
         break;
 
-      d->file->seek(pos);
-      Header header(d->file->readBlock(4));
+      Header header(d->file->readAt(pos, 4));
 
       if(header.isValid()) {
         lastHeader = header;
@@ -192,22 +249,30 @@ void MPEG::Properties::read()
 
   // Now jump back to the front of the file and read what we need from there.
 
-  d->file->seek(first);
-  Header firstHeader(d->file->readBlock(4));
+  Header firstHeader(d->file->readAt(first, 4));
+
+  // The backward scan may have ended up in front of the first frame, e.g. in
+  // the ID3v2 tag.  Don't let the stream length wrap around.
+
+  if(last < first) {
+    last = first;
+    lastHeader = firstHeader;
+  }
 
   if(!firstHeader.isValid() || !lastHeader.isValid()) {
     debug("MPEG::Properties::read() -- Page headers were invalid.");
     return;
   }
 
+  d->streamLength = last + lastHeader.frameLength() - first;
+
   // Check for a Xing header that will help us in gathering information about a
   // VBR stream.
 
   int xingHeaderOffset = MPEG::XingHeader::xingHeaderOffset(firstHeader.version(),
                                                             firstHeader.channelMode());
 
-  d->file->seek(first + xingHeaderOffset);
-  d->xingHeader = new XingHeader(d->file->readBlock(16));
+  d->xingHeader = new XingHeader(d->file->readAt(first + xingHeaderOffset, XingHeader::size()));
 
   // Read the length and the bitrate from the Xing header.
 
@@ -220,20 +285,45 @@ void MPEG::Properties::read()
 
       double length = timePerFrame * d->xingHeader->totalFrames();
 
-      d->length = int(length);
-      d->bitrate = d->length > 0 ? d->xingHeader->totalSize() * 8 / length / 1000 : 0;
+      d->bitrate = int(length) > 0 ? d->xingHeader->totalSize() * 8 / length / 1000 : 0;
+      d->frameCount = d->xingHeader->totalFrames();
+      d->sampleCount = ulong(d->frameCount) * firstHeader.samplesPerFrame();
+
+      // Without the samples the encoder added at both ends the length is
+      // exact to the sample, which matters for gapless playback.
+
+      const ulong added = d->xingHeader->encoderDelay() + d->xingHeader->encoderPadding();
+
+      if(added < d->sampleCount)
+        d->sampleCount -= added;
+
+      d->length = int(double(d->sampleCount) / firstHeader.sampleRate());
   }
-  else {
-    // Since there was no valid Xing header found, we hope that we're in a constant
-    // bitrate file.
+  else if(readVBRIHeader(first, firstHeader)) {
+    delete d->xingHeader;
+    d->xingHeader = 0;
+
+    double length = double(d->sampleCount) / firstHeader.sampleRate();
 
+    d->length = int(length);
+    d->bitrate = d->length > 0 ? d->vbriHeader->totalSize() * 8 / length / 1000 : 0;
+  }
+  else {
     delete d->xingHeader;
     d->xingHeader = 0;
 
-    // TODO: Make this more robust with audio property detection for VBR without a
-    // Xing header.
+    // Without a VBR header the only exact way is to count the frames.  Else we
+    // hope that we're in a constant bitrate file.
+
+    const ulong streamSize = d->style == Accurate ? scanFrames(first, last, firstHeader) : 0;
 
-    if(firstHeader.frameLength() > 0 && firstHeader.bitrate() > 0) {
+    if(streamSize > 0) {
+      const double length = double(d->sampleCount) / firstHeader.sampleRate();
+
+      d->length = int(length);
+      d->bitrate = length > 0 ? int(streamSize * 8 / length / 1000 + 0.5) : 0;
+    }
+    else if(firstHeader.frameLength() > 0 && firstHeader.bitrate() > 0) {
       int frames = (last - first) / firstHeader.frameLength() + 1;
 
       d->length = int(float(firstHeader.frameLength() * frames) /
@@ -252,3 +342,122 @@ void MPEG::Properties::read()
   d->isCopyrighted = firstHeader.isCopyrighted();
   d->isOriginal = firstHeader.isOriginal();
 }
+
+TagLib::ulong MPEG::Properties::scanFrames(long first, long last, const Header &firstHeader)
+{
+  // Walks the headers from the first to the last frame and returns the number
+  // of bytes they cover.  Memory mapped files are read in place, others in
+  // large blocks rather than four bytes a frame.
+
+  ByteVector buffer;
+  const char *data = 0;
+  long dataOffset = 0;
+  ulong dataSize = 0;
+
+  Header header = firstHeader;
+  uint headerBits = 0;
+
+  ulong bytes = 0;
+  long position = first;
+
+  d->seekTable.clear();
+  d->seekInterval = seekTableInterval;
+  d->frameCount = 0;
+  d->sampleCount = 0;
+  d->samplesPerFrame = firstHeader.samplesPerFrame();
+
+  while(position >= 0 && position <= last) {
+
+    if(!data || position + 4 > dataOffset + long(dataSize)) {
+      data = d->file->mappedData(position, &dataSize);
+
+      if(!data) {
+        d->file->seek(position);
+        buffer = d->file->readBlock(File::searchBufferSize());
+        data = buffer.data();
+        dataSize = buffer.size();
+      }
+
+      dataOffset = position;
+
+      if(dataSize < 4)
+        break;
+    }
+
+    const uchar *p = reinterpret_cast<const uchar *>(data + (position - dataOffset));
+    const uint bits = (uint(p[0]) << 24) | (uint(p[1]) << 16) | (uint(p[2]) << 8) | p[3];
+
+    // Most frames share their header with one of the frames before them.
+
+    if(bits != headerBits) {
+      header = Header(ByteVector(reinterpret_cast<const char *>(p), 4));
+      headerBits = bits;
+    }
+
+    if(!header.isValid() || header.frameLength() <= 0 ||
+       header.version() != firstHeader.version() ||
+       header.layer() != firstHeader.layer() ||
+       header.sampleRate() != firstHeader.sampleRate())
+    {
+      // Skip whatever is in the way, junk or a misplaced tag.
+
+      position = d->file->nextFrameOffset(position + 1);
+      continue;
+    }
+
+    if(d->frameCount % seekTableInterval == 0)
+      d->seekTable.push_back(position);
+
+    d->frameCount++;
+    d->sampleCount += header.samplesPerFrame();
+    bytes += header.frameLength();
+    position += header.frameLength();
+  }
+
+  return bytes;
+}
+
+bool MPEG::Properties::readVBRIHeader(long first, const Header &firstHeader)
+{
+  // Fraunhofer encoders write a VBRI header instead of a Xing header.  Its
+  // table of contents follows the fixed part and is only read if it's there.
+
+  const long offset = first + VBRIHeader::vbriHeaderOffset();
+  ByteVector data = d->file->readAt(offset, 26);
+
+  const uint size = VBRIHeader::tableSize(data);
+
+  if(size == 0)
+    return false;
+
+  data.append(d->file->readAt(offset + data.size(), size - data.size()));
+
+  d->vbriHeader = new VBRIHeader(data);
+
+  if(!d->vbriHeader->isValid() || firstHeader.sampleRate() <= 0) {
+    delete d->vbriHeader;
+    d->vbriHeader = 0;
+    return false;
+  }
+
+  d->frameCount = d->vbriHeader->totalFrames();
+  d->sampleCount = ulong(d->frameCount) * firstHeader.samplesPerFrame();
+  d->samplesPerFrame = firstHeader.samplesPerFrame();
+
+  // The sections of the table of contents start at the first frame.
+
+  const List<uint> toc = d->vbriHeader->tableOfContents();
+
+  if(!toc.isEmpty() && d->vbriHeader->framesPerTableEntry() > 0) {
+    long offset = first;
+
+    for(List<uint>::ConstIterator it = toc.begin(); it != toc.end(); ++it) {
+      d->seekTable.push_back(offset);
+      offset += *it;
+    }
+
+    d->seekInterval = d->vbriHeader->framesPerTableEntry();
+  }
+
+  return true;
+}
@@ -37,6 +37,7 @@ namespace TagLib {
 
     class File;
     class XingHeader;
+    class VBRIHeader;
 
     //! An implementation of audio property reading for MP3
 
@@ -73,6 +74,46 @@ namespace TagLib {
 
       const XingHeader *xingHeader() const;
 
+      /*!
+       * Returns a pointer to the VBRIHeader if one exists or null if no
+       * VBRIHeader was found.  This is only checked for if there is no Xing
+       * header.
+       */
+      const VBRIHeader *vbriHeader() const;
+
+      /*!
+       * Returns the number of frames in the stream.  This is only known from a
+       * Xing or VBRI header or if the file was read with the Accurate style,
+       * otherwise this returns 0.
+       */
+      uint frameCount() const;
+
+      /*!
+       * Returns the number of samples per channel in the stream, counted the
+       * same way as frameCount().  The encoder delay and padding from a LAME
+       * tag are not included.
+       */
+      ulong sampleCount() const;
+
+      /*!
+       * Returns the size in bytes of the MPEG stream, from the start of the
+       * first frame to the end of the last one.  Tags and any other data
+       * around the frames are not included.
+       *
+       * Together with bitrate() this gives the length of a constant bitrate
+       * stream more precisely than length(), without reading the file again.
+       */
+      ulong streamLength() const;
+
+      /*!
+       * Returns the offset in the file of a frame that starts shortly before
+       * \a milliseconds into the stream.  The offsets come from the table of
+       * contents of a VBRI header, or are collected when the file is read with
+       * the Accurate style and there is no VBR header.  Otherwise this returns
+       * -1.
+       */
+      long seekOffset(int milliseconds) const;
+
       /*!
        * Returns the MPEG Version of the file.
        */
@@ -108,6 +149,8 @@ namespace TagLib {
       Properties &operator=(const Properties &);
 
       void read();
+      bool readVBRIHeader(long first, const Header &firstHeader);
+      ulong scanFrames(long first, long last, const Header &firstHeader);
 
       class PropertiesPrivate;
       PropertiesPrivate *d;
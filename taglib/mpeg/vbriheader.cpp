@@ -0,0 +1,129 @@
+/***************************************************************************
+ *   This library is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License version   *
+ *   2.1 as published by the Free Software Foundation.                     *
+ *                                                                         *
+ *   This library is distributed in the hope that it will be useful, but   *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU     *
+ *   Lesser General Public License for more details.                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this library; if not, write to the Free Software   *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA         *
+ *   02110-1301  USA                                                       *
+ *                                                                         *
+ *   Alternatively, this file is available under the Mozilla Public        *
+ *   License Version 1.1.  You may obtain a copy of the License at         *
+ *   http://www.mozilla.org/MPL/                                           *
+ ***************************************************************************/
+
+#include <tbytevector.h>
+#include <tstring.h>
+#include <tdebug.h>
+
+#include "vbriheader.h"
+
+using namespace TagLib;
+
+class MPEG::VBRIHeader::VBRIHeaderPrivate
+{
+public:
+  VBRIHeaderPrivate() :
+    frames(0),
+    size(0),
+    framesPerEntry(0),
+    valid(false)
+    {}
+
+  uint frames;
+  uint size;
+  uint framesPerEntry;
+  List<uint> toc;
+  bool valid;
+};
+
+MPEG::VBRIHeader::VBRIHeader(const ByteVector &data)
+{
+  d = new VBRIHeaderPrivate;
+  parse(data);
+}
+
+MPEG::VBRIHeader::~VBRIHeader()
+{
+  delete d;
+}
+
+bool MPEG::VBRIHeader::isValid() const
+{
+  return d->valid;
+}
+
+TagLib::uint MPEG::VBRIHeader::totalFrames() const
+{
+  return d->frames;
+}
+
+TagLib::uint MPEG::VBRIHeader::totalSize() const
+{
+  return d->size;
+}
+
+TagLib::uint MPEG::VBRIHeader::framesPerTableEntry() const
+{
+  return d->framesPerEntry;
+}
+
+TagLib::List<TagLib::uint> MPEG::VBRIHeader::tableOfContents() const
+{
+  return d->toc;
+}
+
+int MPEG::VBRIHeader::vbriHeaderOffset()
+{
+  return 0x24;
+}
+
+TagLib::uint MPEG::VBRIHeader::tableSize(const ByteVector &data)
+{
+  if(data.size() < 26 || !data.startsWith("VBRI"))
+    return 0;
+
+  return 26 + data.mid(18, 2).toUShort() * data.mid(22, 2).toUShort();
+}
+
+void MPEG::VBRIHeader::parse(const ByteVector &data)
+{
+  // The fixed part of the header is:
+  //
+  //   "VBRI", version (2), delay (2), quality (2), stream size (4),
+  //   frames (4), table entries (2), table scale (2), entry size (2),
+  //   frames per entry (2)
+  //
+  // followed by the table of contents.
+
+  if(data.size() < 26 || !data.startsWith("VBRI"))
+    return;
+
+  d->size = data.mid(10, 4).toUInt();
+  d->frames = data.mid(14, 4).toUInt();
+
+  if(d->frames == 0) {
+    debug("MPEG::VBRIHeader::parse() -- VBRI header doesn't contain the total number of frames.");
+    return;
+  }
+
+  d->valid = true;
+
+  const uint entries = data.mid(18, 2).toUShort();
+  const uint scale = data.mid(20, 2).toUShort();
+  const uint entrySize = data.mid(22, 2).toUShort();
+
+  d->framesPerEntry = data.mid(24, 2).toUShort();
+
+  if(entrySize < 1 || entrySize > 4 || data.size() < 26 + entries * entrySize)
+    return;
+
+  for(uint i = 0; i < entries; i++)
+    d->toc.append(data.mid(26 + i * entrySize, entrySize).toUInt() * scale);
+}
@@ -0,0 +1,113 @@
+/***************************************************************************
+ *   This library is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License version   *
+ *   2.1 as published by the Free Software Foundation.                     *
+ *                                                                         *
+ *   This library is distributed in the hope that it will be useful, but   *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU     *
+ *   Lesser General Public License for more details.                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this library; if not, write to the Free Software   *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA         *
+ *   02110-1301  USA                                                       *
+ *                                                                         *
+ *   Alternatively, this file is available under the Mozilla Public        *
+ *   License Version 1.1.  You may obtain a copy of the License at         *
+ *   http://www.mozilla.org/MPL/                                           *
+ ***************************************************************************/
+
+#ifndef TAGLIB_VBRIHEADER_H
+#define TAGLIB_VBRIHEADER_H
+
+#include "mpegheader.h"
+#include "tlist.h"
+#include "taglib_export.h"
+
+namespace TagLib {
+
+  class ByteVector;
+
+  namespace MPEG {
+
+    //! An implementation of the Fraunhofer VBRI headers
+
+    /*!
+     * VBRI headers are written by the Fraunhofer encoders instead of a Xing
+     * header.  Like the Xing header they hold the number of frames and the
+     * size of the stream, which gives the exact playing time and the average
+     * bitrate of a VBR stream.  The table of contents splits the stream into
+     * sections of the same number of frames and holds the size of each.
+     */
+
+    class TAGLIB_EXPORT VBRIHeader
+    {
+    public:
+      /*!
+       * Parses a VBRI header based on \a data, which starts with the "VBRI"
+       * identifier.  The data has to be at least 26 bytes long, plus the size
+       * of the table of contents if that should be read, see tableSize().
+       */
+      VBRIHeader(const ByteVector &data);
+
+      /*!
+       * Destroy this VBRIHeader instance.
+       */
+      virtual ~VBRIHeader();
+
+      /*!
+       * Returns true if the data was parsed properly and if there is a valid
+       * VBRI header present.
+       */
+      bool isValid() const;
+
+      /*!
+       * Returns the total number of frames.
+       */
+      uint totalFrames() const;
+
+      /*!
+       * Returns the total size of stream in bytes.
+       */
+      uint totalSize() const;
+
+      /*!
+       * Returns the number of frames covered by each entry of the table of
+       * contents.
+       */
+      uint framesPerTableEntry() const;
+
+      /*!
+       * Returns the size in bytes of each section of the stream, starting with
+       * the frame that holds this header.  This is empty if the table of
+       * contents wasn't part of the parsed data.
+       */
+      List<uint> tableOfContents() const;
+
+      /*!
+       * Returns the offset of the VBRI header from the start of its frame.
+       * Other than the Xing header it doesn't depend on the side information.
+       */
+      static int vbriHeaderOffset();
+
+      /*!
+       * Returns the number of bytes needed to parse the header in \a data,
+       * including its table of contents, or 0 if \a data doesn't start with a
+       * VBRI header.
+       */
+      static uint tableSize(const ByteVector &data);
+
+    private:
+      VBRIHeader(const VBRIHeader &);
+      VBRIHeader &operator=(const VBRIHeader &);
+
+      void parse(const ByteVector &data);
+
+      class VBRIHeaderPrivate;
+      VBRIHeaderPrivate *d;
+    };
+  }
+}
+
+#endif
@@ -37,14 +37,41 @@ public:
   XingHeaderPrivate() :
     frames(0),
     size(0),
-    valid(false)
+    valid(false),
+    hasLAMETag(false),
+    encoderDelay(0),
+    encoderPadding(0),
+    peak(0),
+    radioGain(0),
+    audiophileGain(0)
     {}
 
   uint frames;
   uint size;
   bool valid;
+  bool hasLAMETag;
+  int encoderDelay;
+  int encoderPadding;
+  float peak;
+  float radioGain;
+  float audiophileGain;
 };
 
+namespace
+{
+  // Replay gain fields of the LAME tag: a 3 bit name (0 if unset), 3 bits
+  // for the originator, a sign bit and the gain in 1/10 dB.
+
+  float replayGain(unsigned short field)
+  {
+    if((field >> 13) == 0)
+      return 0;
+
+    float gain = float(field & 0x1ff) / 10;
+    return field & 0x200 ? -gain : gain;
+  }
+}
+
 MPEG::XingHeader::XingHeader(const ByteVector &data)
 {
   d = new XingHeaderPrivate;
@@ -71,6 +98,44 @@ TagLib::uint MPEG::XingHeader::totalSize() const
   return d->size;
 }
 
+bool MPEG::XingHeader::hasLAMETag() const
+{
+  return d->hasLAMETag;
+}
+
+int MPEG::XingHeader::encoderDelay() const
+{
+  return d->encoderDelay;
+}
+
+int MPEG::XingHeader::encoderPadding() const
+{
+  return d->encoderPadding;
+}
+
+float MPEG::XingHeader::replayGainPeak() const
+{
+  return d->peak;
+}
+
+float MPEG::XingHeader::radioReplayGain() const
+{
+  return d->radioGain;
+}
+
+float MPEG::XingHeader::audiophileReplayGain() const
+{
+  return d->audiophileGain;
+}
+
+TagLib::uint MPEG::XingHeader::size()
+{
+  // 16 bytes of header, frames and size, 100 bytes of TOC, 4 bytes quality
+  // and 36 bytes of LAME tag.
+
+  return 156;
+}
+
 int MPEG::XingHeader::xingHeaderOffset(TagLib::MPEG::Header::Version v,
                                        TagLib::MPEG::Header::ChannelMode c)
 {
@@ -92,7 +157,7 @@ void MPEG::XingHeader::parse(const ByteVector &data)
 {
   // Check to see if a valid Xing header is available.
 
-  if(!data.startsWith("Xing") && !data.startsWith("Info"))
+  if(data.size() < 16 || (!data.startsWith("Xing") && !data.startsWith("Info")))
     return;
 
   // If the XingHeader doesn't contain the number of frames and the total stream
@@ -112,4 +177,33 @@ void MPEG::XingHeader::parse(const ByteVector &data)
   d->size = data.mid(12, 4).toUInt();
 
   d->valid = true;
+
+  // The LAME tag follows the optional table of contents and quality fields.
+  // FFmpeg writes the same tag with its own encoder name.
+
+  uint offset = 16;
+
+  if(data[7] & 0x04)
+    offset += 100;
+
+  if(data[7] & 0x08)
+    offset += 4;
+
+  if(data.size() < offset + 24)
+    return;
+
+  if(!data.containsAt("LAME", offset) && !data.containsAt("Lavf", offset) &&
+     !data.containsAt("Lavc", offset))
+    return;
+
+  d->hasLAMETag = true;
+
+  d->peak = float(data.mid(offset + 11, 4).toUInt()) / (1 << 23);
+  d->radioGain = replayGain(data.mid(offset + 15, 2).toUShort());
+  d->audiophileGain = replayGain(data.mid(offset + 17, 2).toUShort());
+
+  // Two 12 bit values
+
+  d->encoderDelay = (uchar(data[offset + 21]) << 4) | (uchar(data[offset + 22]) >> 4);
+  d->encoderPadding = ((uchar(data[offset + 22]) & 0x0f) << 8) | uchar(data[offset + 23]);
 }
@@ -52,7 +52,8 @@ namespace TagLib {
     public:
       /*!
        * Parses a Xing header based on \a data.  The data must be at least 16
-       * bytes long (anything longer than this is discarded).
+       * bytes long.  The LAME tag is only read if \a data also holds it, which
+       * takes up to 156 bytes, see size().
        */
       XingHeader(const ByteVector &data);
 
@@ -77,6 +78,47 @@ namespace TagLib {
        */
       uint totalSize() const;
 
+      /*!
+       * Returns true if the Xing header is followed by a LAME tag.  The values
+       * below are only set if it is.
+       */
+      bool hasLAMETag() const;
+
+      /*!
+       * Returns the number of samples the encoder added to the start of the
+       * stream.
+       */
+      int encoderDelay() const;
+
+      /*!
+       * Returns the number of samples the encoder added to the end of the
+       * stream to fill up the last frame.
+       */
+      int encoderPadding() const;
+
+      /*!
+       * Returns the peak amplitude of the stream, where 1.0 is full scale, or
+       * 0 if it isn't known.
+       */
+      float replayGainPeak() const;
+
+      /*!
+       * Returns the radio (track) replay gain in dB, or 0 if it isn't known.
+       */
+      float radioReplayGain() const;
+
+      /*!
+       * Returns the audiophile (album) replay gain in dB, or 0 if it isn't
+       * known.
+       */
+      float audiophileReplayGain() const;
+
+      /*!
+       * Returns the number of bytes needed for the largest Xing header
+       * including the LAME tag.
+       */
+      static uint size();
+
       /*!
        * Returns the offset for the start of this Xing header, given the
        * version and channels of the frame
@@ -28,24 +28,85 @@
 #include <tstring.h>
 
 #include "rifffile.h"
+#include <string.h>
+#include <algorithm>
 #include <vector>
 
 using namespace TagLib;
 
 struct Chunk
 {
-  ByteVector name;
-  TagLib::uint offset;
-  TagLib::uint size;
+  char name[4];
+  offset_t offset;
+  offset_t size;
   char padding;
 };
 
+// An entry of the table in the ds64 chunk of an RF64 file
+struct ChunkSize
+{
+  char name[4];
+  offset_t size;
+};
+
+namespace
+{
+  // Chunk headers are read in blocks of this size, so that a run of small
+  // chunks only costs a single read.
+  const TagLib::uint chunkHeaderBlockSize = 4096;
+
+  // Hands out pointers to the bytes at a given offset, straight from the
+  // mapping if the file is memory mapped and otherwise from a block that is
+  // refilled whenever the requested bytes aren't in it.
+  class ChunkReader
+  {
+  public:
+    ChunkReader(File *file) : file(file), blockOffset(0) {}
+
+    const char *data(offset_t offset, TagLib::uint length)
+    {
+      ulong mappedLength = 0;
+      const char *mapped = offset_t(ulong(offset)) == offset ? file->mappedData(offset, &mappedLength) : 0;
+
+      if(mapped)
+        return mappedLength >= length ? mapped : 0;
+
+      if(offset < blockOffset || offset + length > blockOffset + block.size()) {
+        file->seek(offset);
+        block = file->readBlock(std::max(length, chunkHeaderBlockSize));
+        blockOffset = offset;
+
+        if(block.size() < length)
+          return 0;
+      }
+
+      return block.data() + (offset - blockOffset);
+    }
+
+  private:
+    File *file;
+    ByteVector block;
+    offset_t blockOffset;
+  };
+
+  // RF64 (EBU Tech 3306) and BW64 (ITU-R BS.2088) files store the sizes that
+  // don't fit into 32 bits in a ds64 chunk, the 32-bit fields are set to this.
+  const TagLib::uint sizeInDS64 = 0xFFFFFFFF;
+
+  // A ds64 chunk is 28 bytes plus 12 bytes for each entry of its table, this
+  // bounds the table to a sane number of entries.
+  const TagLib::uint maxDS64Size = 28 + 12 * 1024;
+}
+
 class RIFF::File::FilePrivate
 {
 public:
   FilePrivate() :
     endianness(BigEndian),
-    size(0)
+    size(0),
+    nextChunkOffset(-1),
+    isRF64(false),
+    dataSize(-1)
   {
 
   }
@@ -55,6 +116,14 @@ public:
   ByteVector format;
 
   std::vector<Chunk> chunks;
+
+  // Where read() continues, -1 once all chunk headers have been read
+  offset_t nextChunkOffset;
+
+  // The 64-bit sizes from the ds64 chunk of an RF64 file
+  bool isRF64;
+  offset_t dataSize;
+  std::vector<ChunkSize> chunkSizes;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -76,7 +145,17 @@ RIFF::File::File(FileName file, Endianness endianness) : TagLib::File(file)
   d->endianness = endianness;
 
   if(isOpen())
-    read();
+    readHeader();
+}
+
+RIFF::File::File(FileName file, Endianness endianness, bool memoryMap) :
+  TagLib::File(file, memoryMap)
+{
+  d = new FilePrivate;
+  d->endianness = endianness;
+
+  if(isOpen())
+    readHeader();
 }
 
 TagLib::uint RIFF::File::riffSize() const
@@ -86,58 +165,83 @@ TagLib::uint RIFF::File::riffSize() const
 
 TagLib::uint RIFF::File::chunkCount() const
 {
+  // The chunk headers are read lazily, see findChunk().
+
+  if(d->nextChunkOffset >= 0)
+    const_cast<File *>(this)->read(ByteVector::null);
+
   return d->chunks.size();
 }
 
-TagLib::uint RIFF::File::chunkDataSize(uint i) const
+offset_t RIFF::File::chunkDataSize(uint i) const
 {
+  if(i >= d->chunks.size() && i >= chunkCount())
+    return 0;
+
   return d->chunks[i].size;
 }
 
-TagLib::uint RIFF::File::chunkOffset(uint i) const
+offset_t RIFF::File::chunkOffset(uint i) const
 {
+  if(i >= d->chunks.size() && i >= chunkCount())
+    return 0;
+
   return d->chunks[i].offset;
 }
 
 TagLib::uint RIFF::File::chunkPadding(uint i) const
 {
+  if(i >= d->chunks.size() && i >= chunkCount())
+    return 0;
+
   return d->chunks[i].padding;
 }
 
 ByteVector RIFF::File::chunkName(uint i) const
 {
-  if(i >= chunkCount())
+  if(i >= d->chunks.size() && i >= chunkCount())
     return ByteVector::null;
 
-  return d->chunks[i].name;
+  return ByteVector(d->chunks[i].name, 4);
 }
 
 ByteVector RIFF::File::chunkData(uint i)
 {
-  if(i >= chunkCount())
+  if(i >= d->chunks.size() && i >= chunkCount())
     return ByteVector::null;
 
-  // Offset for the first subchunk's data
+  seek(d->chunks[i].offset);
 
-  long begin = 12 + 8;
+  return readBlock(ulong(d->chunks[i].size));
+}
 
-  for(uint it = 0; it < i; it++)
-    begin += 8 + d->chunks[it].size + d->chunks[it].padding;
+int RIFF::File::findChunk(const ByteVector &name)
+{
+  if(name.size() != 4)
+    return -1;
 
-  seek(begin);
+  for(uint i = 0; i < d->chunks.size(); i++) {
+    if(memcmp(d->chunks[i].name, name.data(), 4) == 0)
+      return i;
+  }
 
-  return readBlock(d->chunks[i].size);
+  return d->nextChunkOffset >= 0 ? read(name) : -1;
 }
 
 void RIFF::File::setChunkData(const ByteVector &name, const ByteVector &data)
 {
-  if(d->chunks.size() == 0) {
+  if(chunkCount() == 0) {
     debug("RIFF::File::setChunkData - No valid chunks found.");
     return;
   }
 
+  if(d->isRF64) {
+    debug("RIFF::File::setChunkData - Writing RF64 files is not supported.");
+    return;
+  }
+
   for(uint i = 0; i < d->chunks.size(); i++) {
-    if(d->chunks[i].name == name) {
+    if(name.size() == 4 && memcmp(d->chunks[i].name, name.data(), 4) == 0) {
 
       // First we update the global size
 
@@ -146,7 +250,7 @@ void RIFF::File::setChunkData(const ByteVector &name, const ByteVector &data)
 
       // Now update the specific chunk
 
-      writeChunk(name, data, d->chunks[i].offset - 8, d->chunks[i].size + d->chunks[i].padding + 8);
+      writeChunk(name, data, ulong(d->chunks[i].offset - 8), ulong(d->chunks[i].size + d->chunks[i].padding + 8));
 
       d->chunks[i].size = data.size();
       d->chunks[i].padding = (data.size() & 0x01) ? 1 : 0;
@@ -163,7 +267,7 @@ void RIFF::File::setChunkData(const ByteVector &name, const ByteVector &data)
   // Couldn't find an existing chunk, so let's create a new one.
 
   uint i =  d->chunks.size() - 1;
-  ulong offset = d->chunks[i].offset + d->chunks[i].size;
+  offset_t offset = d->chunks[i].offset + d->chunks[i].size;
 
   // First we update the global size
 
@@ -172,7 +276,7 @@ void RIFF::File::setChunkData(const ByteVector &name, const ByteVector &data)
 
   // Now add the chunk to the file
 
-  writeChunk(name, data, offset, std::max(ulong(0), length() - offset), (offset & 1) ? 1 : 0);
+  writeChunk(name, data, ulong(offset), ulong(std::max(offset_t(0), length() - offset)), (offset & 1) ? 1 : 0);
 
   // And update our internal structure
 
@@ -182,7 +286,7 @@ void RIFF::File::setChunkData(const ByteVector &name, const ByteVector &data)
   }
   
   Chunk chunk;
-  chunk.name = name;
+  memcpy(chunk.name, name.data(), std::min(name.size(), TagLib::uint(4)));
   chunk.size = data.size();
   chunk.offset = offset + 8;
   chunk.padding = (data.size() & 0x01) ? 1 : 0;
@@ -194,47 +298,115 @@ void RIFF::File::setChunkData(const ByteVector &name, const ByteVector &data)
 // private members
 ////////////////////////////////////////////////////////////////////////////////
 
-void RIFF::File::read()
+void RIFF::File::readHeader()
 {
   bool bigEndian = (d->endianness == BigEndian);
 
-  d->type = readBlock(4);
-  d->size = readBlock(4).toUInt(bigEndian);
-  d->format = readBlock(4);
+  ByteVector header = readBlock(12);
+
+  if(header.size() < 12)
+    return;
+
+  d->type = header.mid(0, 4);
+  d->size = header.mid(4, 4).toUInt(bigEndian);
+  d->format = header.mid(8, 4);
+
+  d->isRF64 = !bigEndian && (d->type == "RF64" || d->type == "BW64");
+
+  d->nextChunkOffset = 12;
+}
+
+int RIFF::File::read(const ByteVector &until)
+{
+  bool bigEndian = (d->endianness == BigEndian);
+
+  ChunkReader reader(this);
+  offset_t fileLength = length();
 
   // + 8: chunk header at least, fix for additional junk bytes
-  while(tell() + 8 <= length()) {
-    ByteVector chunkName = readBlock(4);
-    uint chunkSize = readBlock(4).toUInt(bigEndian);
+  while(d->nextChunkOffset >= 0 && d->nextChunkOffset + 8 <= fileLength) {
+    offset_t offset = d->nextChunkOffset;
+    const char *header = reader.data(offset, 8);
+
+    if(!header)
+      break;
+
+    offset_t chunkSize = ByteVector(header + 4, 4).toUInt(bigEndian);
+
+    if(d->isRF64 && chunkSize == sizeInDS64)
+      chunkSize = rf64ChunkSize(header);
 
-    if(tell() + chunkSize > uint(length())) {
+    if(chunkSize < 0 || chunkSize > fileLength - offset - 8) {
       // something wrong
       break;
     }
 
     Chunk chunk;
-    chunk.name = chunkName;
+    memcpy(chunk.name, header, 4);
     chunk.size = chunkSize;
-    chunk.offset = tell();
+    chunk.offset = offset + 8;
 
-    seek(chunk.size, Current);
-
-    // check padding
+    // check padding, if it's not a zero byte the file is not well formed and
+    // the next chunk starts right away
     chunk.padding = 0;
-    long uPosNotPadded = tell();
+    offset_t uPosNotPadded = chunk.offset + chunk.size;
     if((uPosNotPadded & 0x01) != 0) {
-      ByteVector iByte = readBlock(1);
-      if((iByte.size() != 1) || (iByte[0] != 0)) {
-        // not well formed, re-seek
-        seek(uPosNotPadded, Beginning);
-      }
-      else {
+      const char *iByte = reader.data(uPosNotPadded, 1);
+      if(iByte && *iByte == 0)
         chunk.padding = 1;
-      }
     }
+
     d->chunks.push_back(chunk);
+    d->nextChunkOffset = uPosNotPadded + chunk.padding;
 
+    // The ds64 chunk has to come first in an RF64 file.
+
+    if(d->isRF64 && d->chunks.size() == 1 && memcmp(chunk.name, "ds64", 4) == 0 &&
+       chunk.size >= 28 && chunk.size <= maxDS64Size)
+    {
+      const char *ds64 = reader.data(chunk.offset, uint(chunk.size));
+
+      if(ds64)
+        readDS64(ByteVector(ds64, uint(chunk.size)));
+    }
+
+    if(until.size() == 4 && memcmp(chunk.name, until.data(), 4) == 0)
+      return d->chunks.size() - 1;
   }
+
+  d->nextChunkOffset = -1;
+
+  return -1;
+}
+
+void RIFF::File::readDS64(const ByteVector &data)
+{
+  // riffSize (8), dataSize (8), sampleCount (8), tableLength (4), followed by
+  // the table of chunk IDs (4) and their sizes (8)
+
+  d->dataSize = data.mid(8, 8).toLongLong(false);
+
+  const uint tableLength = data.mid(24, 4).toUInt(false);
+
+  for(uint i = 0; i < tableLength && 28 + (i + 1) * 12 <= data.size(); i++) {
+    ChunkSize entry;
+    memcpy(entry.name, data.data() + 28 + i * 12, 4);
+    entry.size = data.mid(28 + i * 12 + 4, 8).toLongLong(false);
+    d->chunkSizes.push_back(entry);
+  }
+}
+
+offset_t RIFF::File::rf64ChunkSize(const char *name) const
+{
+  if(memcmp(name, "data", 4) == 0)
+    return d->dataSize;
+
+  for(uint i = 0; i < d->chunkSizes.size(); i++) {
+    if(memcmp(d->chunkSizes[i].name, name, 4) == 0)
+      return d->chunkSizes[i].size;
+  }
+
+  return sizeInDS64;
 }
 
 void RIFF::File::writeChunk(const ByteVector &name, const ByteVector &data,
@@ -41,6 +41,9 @@ namespace TagLib {
      * This implements the generic TagLib::File API and additionally provides
      * access to properties that are distinct to RIFF files, notably access
      * to the different ID3 tags.
+     *
+     * RF64 and BW64 files, which keep the sizes of chunks above 4 GiB in a
+     * ds64 chunk, can be read but not written.
      */
 
     class TAGLIB_EXPORT File : public TagLib::File
@@ -57,6 +60,12 @@ namespace TagLib {
 
       File(FileName file, Endianness endianness);
 
+      /*!
+       * Same as above, the file is memory mapped if \a memoryMap is true.
+       */
+      // BIC: merge with the above constructor
+      File(FileName file, Endianness endianness, bool memoryMap);
+
       /*!
        * \return The size of the main RIFF chunk.
        */
@@ -64,18 +73,21 @@ namespace TagLib {
 
       /*!
        * \return The number of chunks in the file.
+       *
+       * \note This reads all chunk headers that haven't been read yet.
        */
       uint chunkCount() const;
 
       /*!
        * \return The offset within the file for the selected chunk number.
        */
-      uint chunkOffset(uint i) const;
+      offset_t chunkOffset(uint i) const;
 
       /*!
-       * \return The size of the chunk data.
+       * \return The size of the chunk data.  For RF64 files this is the 64-bit
+       * size from the ds64 chunk where the chunk header doesn't hold it.
        */
-      uint chunkDataSize(uint i) const;
+      offset_t chunkDataSize(uint i) const;
 
       /*!
        * \return The size of the padding after the chunk (can be either 0 or 1).
@@ -94,6 +106,15 @@ namespace TagLib {
        */
       ByteVector chunkData(uint i);
 
+      /*!
+       * \return The index of the first chunk called \a name, or -1 if there
+       * is none.
+       *
+       * The chunk headers are read from the file only as far as necessary, so
+       * a file whose chunks of interest come first isn't walked to the end.
+       */
+      int findChunk(const ByteVector &name);
+
       /*!
        * Sets the data for the chunk \a name to \a data.  If a chunk with the
        * given name already exists it will be overwritten, otherwise it will be
@@ -107,7 +128,10 @@ namespace TagLib {
       File(const File &);
       File &operator=(const File &);
 
-      void read();
+      void readHeader();
+      int read(const ByteVector &until);
+      void readDS64(const ByteVector &data);
+      offset_t rf64ChunkSize(const char *name) const;
       void writeChunk(const ByteVector &name, const ByteVector &data,
                       ulong offset, ulong replace = 0,
                       uint leadingPadding = 0);
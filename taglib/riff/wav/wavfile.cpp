@@ -65,6 +65,16 @@ RIFF::WAV::File::File(FileName file, bool readProperties,
     read(readProperties, propertiesStyle);
 }
 
+RIFF::WAV::File::File(FileName file, bool readProperties,
+                       Properties::ReadStyle propertiesStyle, bool readTags,
+                       bool memoryMap) :
+  RIFF::File(file, LittleEndian, memoryMap)
+{
+  d = new FilePrivate;
+  if(isOpen())
+    read(readProperties, propertiesStyle, readTags);
+}
+
 RIFF::WAV::File::~File()
 {
   delete d;
@@ -87,33 +97,73 @@ bool RIFF::WAV::File::save()
     return false;
   }
 
+  if(!d->tag) {
+    debug("RIFF::WAV::File::save() -- The tag has not been read.");
+    return false;
+  }
+
   setChunkData(d->tagChunkID, d->tag->render());
 
   return true;
 }
 
+void RIFF::WAV::File::readTags()
+{
+  if(d->tag)
+    return;
+
+  for(uint i = 0; i < chunkCount(); i++) {
+    // ID3v2::Tag takes a long offset, which can't reach past 2 GiB on 32-bit
+    // systems.
+
+    if(chunkOffset(i) != long(chunkOffset(i)))
+      continue;
+
+    if(chunkName(i) == "ID3 " || chunkName(i) == "id3 ") {
+      d->tagChunkID = chunkName(i);
+      d->tag = new ID3v2::Tag(this, chunkOffset(i));
+    }
+  }
+
+  if(!d->tag)
+    d->tag = new ID3v2::Tag;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // private members
 ////////////////////////////////////////////////////////////////////////////////
 
-void RIFF::WAV::File::read(bool readProperties, Properties::ReadStyle propertiesStyle)
+void RIFF::WAV::File::read(bool readProperties, Properties::ReadStyle propertiesStyle,
+                           bool parseTags)
 {
+  // Only the chunks needed for the properties are looked up, which usually
+  // come first.  The rest is read when the tags are.
+
   ByteVector formatData;
-  uint streamLength = 0;
-  for(uint i = 0; i < chunkCount(); i++) {
-    if(chunkName(i) == "ID3 " || chunkName(i) == "id3 ") {
-      d->tagChunkID = chunkName(i);
-      d->tag = new ID3v2::Tag(this, chunkOffset(i));
+  offset_t streamLength = 0;
+  uint factSampleFrames = 0;
+
+  if(readProperties) {
+    int formatChunk = findChunk("fmt ");
+    int dataChunk = findChunk("data");
+
+    if(formatChunk >= 0)
+      formatData = chunkData(formatChunk);
+    if(dataChunk >= 0)
+      streamLength = chunkDataSize(dataChunk);
+
+    // Compressed formats store the number of samples in a fact chunk
+
+    if(formatData.size() >= 2 && formatData.mid(0, 2).toUShort(false) != 1) {
+      int factChunk = findChunk("fact");
+      if(factChunk >= 0 && chunkDataSize(factChunk) >= 4)
+        factSampleFrames = chunkData(factChunk).mid(0, 4).toUInt(false);
     }
-    else if(chunkName(i) == "fmt " && readProperties)
-      formatData = chunkData(i);
-    else if(chunkName(i) == "data" && readProperties)
-      streamLength = chunkDataSize(i);
   }
 
   if(!formatData.isEmpty())
-    d->properties = new Properties(formatData, streamLength, propertiesStyle);
+    d->properties = new Properties(formatData, streamLength, factSampleFrames, propertiesStyle);
 
-  if(!d->tag)
-    d->tag = new ID3v2::Tag;
+  if(parseTags)
+    readTags();
 }
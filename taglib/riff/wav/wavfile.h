@@ -65,6 +65,17 @@ namespace TagLib {
         File(FileName file, bool readProperties = true,
              Properties::ReadStyle propertiesStyle = Properties::Average);
 
+        /*!
+         * Contructs an WAV file from \a file.  If \a readTags is false the ID3v2
+         * chunk is skipped, tag() returns a null pointer and the file can't be
+         * saved until readTags() is called.  If \a memoryMap is true the file
+         * is read through a memory mapping.
+         */
+        // BIC: merge with the above constructor
+        File(FileName file, bool readProperties,
+             Properties::ReadStyle propertiesStyle, bool readTags,
+             bool memoryMap = false);
+
         /*!
          * Destroys this instance of the File.
          */
@@ -86,11 +97,18 @@ namespace TagLib {
          */
         virtual bool save();
 
+        /*!
+         * Parses the ID3v2 chunk of a file that was opened with \a readTags set
+         * to false.  Does nothing if it has been read already.
+         */
+        void readTags();
+
       private:
         File(const File &);
         File &operator=(const File &);
 
-        void read(bool readProperties, Properties::ReadStyle propertiesStyle);
+        void read(bool readProperties, Properties::ReadStyle propertiesStyle,
+                  bool parseTags = true);
 
         class FilePrivate;
         FilePrivate *d;
@@ -35,14 +35,17 @@ using namespace TagLib;
 class RIFF::WAV::Properties::PropertiesPrivate
 {
 public:
-  PropertiesPrivate(uint streamLength = 0) :
+  PropertiesPrivate(offset_t streamLength = 0) :
     format(0),
     length(0),
     bitrate(0),
     sampleRate(0),
     channels(0),
     sampleWidth(0),
-    streamLength(streamLength)
+    sampleFrames(0),
+    sampleFramesExact(false),
+    streamLength(streamLength),
+    factSampleFrames(0)
   {
 
   }
@@ -53,7 +56,10 @@ public:
   int sampleRate;
   int channels;
   int sampleWidth;
-  uint streamLength;
+  unsigned long long sampleFrames;
+  bool sampleFramesExact;
+  offset_t streamLength;
+  uint factSampleFrames;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -66,12 +72,20 @@ RIFF::WAV::Properties::Properties(const ByteVector &data, ReadStyle style) : Aud
   read(data);
 }
 
-RIFF::WAV::Properties::Properties(const ByteVector &data, uint streamLength, ReadStyle style) : AudioProperties(style)
+RIFF::WAV::Properties::Properties(const ByteVector &data, offset_t streamLength, ReadStyle style) : AudioProperties(style)
 {
   d = new PropertiesPrivate(streamLength);
   read(data);
 }
 
+RIFF::WAV::Properties::Properties(const ByteVector &data, offset_t streamLength, uint factSampleFrames,
+                                  ReadStyle style) : AudioProperties(style)
+{
+  d = new PropertiesPrivate(streamLength);
+  d->factSampleFrames = factSampleFrames;
+  read(data);
+}
+
 RIFF::WAV::Properties::~Properties()
 {
   delete d;
@@ -102,6 +116,16 @@ int RIFF::WAV::Properties::sampleWidth() const
   return d->sampleWidth;
 }
 
+unsigned long long RIFF::WAV::Properties::sampleFrames() const
+{
+  return d->sampleFrames;
+}
+
+bool RIFF::WAV::Properties::isSampleFramesExact() const
+{
+  return d->sampleFramesExact;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // private members
 ////////////////////////////////////////////////////////////////////////////////
@@ -116,5 +140,30 @@ void RIFF::WAV::Properties::read(const ByteVector &data)
   uint byteRate = data.mid(8, 4).toUInt(false);
   d->bitrate = byteRate * 8 / 1000;
 
-  d->length = byteRate > 0 ? d->streamLength / byteRate : 0;
+  d->length = byteRate > 0 ? int(d->streamLength / byteRate) : 0;
+
+  // The sample width only tells the size of a sample frame for uncompressed
+  // data.  WAVE_FORMAT_EXTENSIBLE keeps the real format in the first two
+  // bytes of the subformat GUID.
+
+  unsigned short format = (unsigned short)d->format;
+  if(format == 0xfffe && data.size() >= 26)
+    format = data.mid(24, 2).toUShort(false);
+
+  const bool uncompressed = format == 1 || format == 3;
+
+  if(uncompressed) {
+    if(d->channels > 0 && d->sampleWidth > 0) {
+      d->sampleFrames = d->streamLength / (d->channels * ((d->sampleWidth + 7) / 8));
+      d->sampleFramesExact = true;
+    }
+  }
+  else if(d->factSampleFrames > 0 && d->factSampleFrames != 0xffffffff) {
+    // RF64 files keep a larger count in the ds64 chunk and set this to -1
+    d->sampleFrames = d->factSampleFrames;
+    d->sampleFramesExact = true;
+  }
+  else if(byteRate > 0) {
+    d->sampleFrames = (unsigned long long)d->streamLength * d->sampleRate / byteRate;
+  }
 }
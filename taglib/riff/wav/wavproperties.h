@@ -59,7 +59,15 @@ namespace TagLib {
 	 * Create an instance of WAV::Properties with the data read from the
 	 * ByteVector \a data and the length calculated using \a streamLength.
 	 */
-	Properties(const ByteVector &data, uint streamLength, ReadStyle style);
+	Properties(const ByteVector &data, offset_t streamLength, ReadStyle style);
+
+	/*!
+	 * Create an instance of WAV::Properties with the data read from the
+	 * ByteVector \a data, the length calculated using \a streamLength and
+	 * the sample count \a factSampleFrames from the fact chunk, 0 if there
+	 * is none.
+	 */
+	Properties(const ByteVector &data, offset_t streamLength, uint factSampleFrames, ReadStyle style);
 
 	/*!
 	 * Destroys this WAV::Properties instance.
@@ -75,6 +83,21 @@ namespace TagLib {
 
 	int sampleWidth() const;
 
+	/*!
+	 * Returns the number of sample frames, the samples per channel in the
+	 * data chunk.  This is counted for PCM and floating point data, taken
+	 * from the fact chunk for compressed formats, and estimated from the
+	 * byte rate if a compressed file has no fact chunk.
+	 *
+	 * \see isSampleFramesExact()
+	 */
+	unsigned long long sampleFrames() const;
+
+	/*!
+	 * Returns false if sampleFrames() has been estimated from the byte rate.
+	 */
+	bool isSampleFramesExact() const;
+
       private:
 	Properties(const Properties &);
 	Properties &operator=(const Properties &);
@@ -74,6 +74,7 @@ HEADERS += audioproperties.h \
            mpeg/mpegheader.h \
            mpeg/mpegproperties.h \
            mpeg/xingheader.h \
+           mpeg/vbriheader.h \
            ogg/oggfile.h \
            ogg/oggpage.h \
            ogg/oggpageheader.h \
@@ -87,6 +88,7 @@ HEADERS += audioproperties.h \
            toolkit/tfile.h \
            toolkit/tlist.h \
            toolkit/tmap.h \
+           toolkit/tsimd.h \
            toolkit/tstring.h \
            toolkit/tstringlist.h \
            toolkit/unicode.h \
@@ -163,6 +165,7 @@ SOURCES += ape/apefooter.cpp \
            mpeg/mpegheader.cpp \
            mpeg/mpegproperties.cpp \
            mpeg/xingheader.cpp \
+           mpeg/vbriheader.cpp \
            ogg/flac/oggflacfile.cpp \
            ogg/oggfile.cpp \
            ogg/oggpage.cpp \
@@ -237,6 +240,7 @@ FRAMEWORK_HEADERS.files = \
            mpeg/mpegheader.h \
            mpeg/mpegproperties.h \
            mpeg/xingheader.h \
+           mpeg/vbriheader.h \
            ogg/flac/oggflacfile.h \
            ogg/oggfile.h \
            ogg/oggpage.h \
@@ -44,6 +44,16 @@
 
 #include <string>
 
+// Shared data (ByteVector, String, ...) may be handed between threads, e.g. the
+// static null instances, so the reference counts have to be updated atomically.
+
+#if defined(_MSC_VER)
+# include <intrin.h>
+# define TAGLIB_ATOMIC_WIN
+#elif defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+# define TAGLIB_ATOMIC_GCC
+#endif
+
 //! A namespace for all TagLib related classes and functions
 
 /*!
@@ -63,6 +73,12 @@ namespace TagLib {
   typedef unsigned int  uint;
   typedef unsigned long ulong;
 
+  /*!
+   * File offsets and sizes, 64 bits wide on every platform so that files
+   * larger than 2 GiB can be read on 32-bit systems as well.
+   */
+  typedef long long offset_t;
+
   /*!
    * Unfortunately std::wstring isn't defined on some systems, (i.e. GCC < 3)
    * so I'm providing something here that should be constant.
@@ -81,11 +97,25 @@ namespace TagLib {
   {
   public:
     RefCounter() : refCount(1) {}
+#if defined(TAGLIB_ATOMIC_WIN)
+    void ref() { _InterlockedIncrement(&refCount); }
+    bool deref() { return ! _InterlockedDecrement(&refCount); }
+    int count() { return refCount; }
+  private:
+    volatile long refCount;
+#elif defined(TAGLIB_ATOMIC_GCC)
+    void ref() { __sync_add_and_fetch(&refCount, 1); }
+    bool deref() { return ! __sync_sub_and_fetch(&refCount, 1); }
+    int count() { return refCount; }
+  private:
+    volatile int refCount;
+#else
     void ref() { refCount++; }
     bool deref() { return ! --refCount ; }
     int count() { return refCount; }
   private:
     uint refCount;
+#endif
   };
 
 #endif // DO_NOT_DOCUMENT
@@ -29,18 +29,12 @@
 #include <tdebug.h>
 
 #include <string.h>
+#include <algorithm>
 
 #include "tbytevector.h"
 
 // This is a bit ugly to keep writing over and over again.
 
-// A rather obscure feature of the C++ spec that I hadn't thought of that makes
-// working with C libs much more effecient.  There's more here:
-//
-// http://www.informit.com/isapi/product_id~{9C84DAB4-FE6E-49C5-BB0A-FB50331233EA}/content/index.asp
-
-#define DATA(x) (&(x->data[0]))
-
 namespace TagLib {
   static const char hexTable[17] = "0123456789abcdef";
 
@@ -201,17 +195,17 @@ namespace TagLib {
   };
 
   template <class T>
-  T toNumber(const std::vector<char> &data, bool mostSignificantByteFirst)
+  T toNumber(const char *data, uint dataSize, bool mostSignificantByteFirst)
   {
     T sum = 0;
 
-    if(data.size() <= 0) {
+    if(dataSize <= 0) {
       debug("ByteVectorMirror::toNumber<T>() -- data is empty, returning 0");
       return sum;
     }
 
     uint size = sizeof(T);
-    uint last = data.size() > size ? size - 1 : data.size() - 1;
+    uint last = dataSize > size ? size - 1 : dataSize - 1;
 
     for(uint i = 0; i <= last; i++)
       sum |= (T) uchar(data[i]) << ((mostSignificantByteFirst ? last - i : i) * 8);
@@ -238,15 +232,56 @@ using namespace TagLib;
 class ByteVector::ByteVectorPrivate : public RefCounter
 {
 public:
-  ByteVectorPrivate() : RefCounter(), size(0) {}
-  ByteVectorPrivate(const std::vector<char> &v) : RefCounter(), data(v), size(v.size()) {}
-  ByteVectorPrivate(TagLib::uint len, char value) : RefCounter(), data(len, value), size(len) {}
+  ByteVectorPrivate() : RefCounter(), data(inlineData), size(0), capacity(inlineSize) {}
+
+  ByteVectorPrivate(const char *s, TagLib::uint len) :
+    RefCounter(), data(inlineData), size(0), capacity(inlineSize)
+  {
+    reserve(len);
+    if(len > 0)
+      ::memcpy(data, s, len);
+    size = len;
+  }
 
-  std::vector<char> data;
+  ByteVectorPrivate(TagLib::uint len, char value) :
+    RefCounter(), data(inlineData), size(0), capacity(inlineSize)
+  {
+    reserve(len);
+    ::memset(data, value, len);
+    size = len;
+  }
 
-  // std::vector<T>::size() is very slow, so we'll cache the value
+  ~ByteVectorPrivate()
+  {
+    if(data != inlineData)
+      delete [] data;
+  }
 
+  void reserve(TagLib::uint length)
+  {
+    if(length <= capacity)
+      return;
+
+    char *buffer = new char[length];
+    ::memcpy(buffer, data, size);
+
+    if(data != inlineData)
+      delete [] data;
+
+    data = buffer;
+    capacity = length;
+  }
+
+  // Most vectors hold a frame header, a chunk ID or a number that is about
+  // to be converted.  Up to this size the bytes are stored right here instead
+  // of in a second allocation.
+
+  static const TagLib::uint inlineSize = 24;
+
+  char *data;
   uint size;
+  uint capacity;
+  char inlineData[inlineSize];
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -303,21 +338,17 @@ ByteVector::ByteVector(const ByteVector &v) : d(v.d)
 
 ByteVector::ByteVector(char c)
 {
-  d = new ByteVectorPrivate;
-  d->data.push_back(c);
-  d->size = 1;
+  d = new ByteVectorPrivate(&c, 1);
 }
 
 ByteVector::ByteVector(const char *data, uint length)
 {
-  d = new ByteVectorPrivate;
-  setData(data, length);
+  d = new ByteVectorPrivate(data, length);
 }
 
 ByteVector::ByteVector(const char *data)
 {
-  d = new ByteVectorPrivate;
-  setData(data);
+  d = new ByteVectorPrivate(data, ::strlen(data));
 }
 
 ByteVector::~ByteVector()
@@ -333,7 +364,7 @@ ByteVector &ByteVector::setData(const char *data, uint length)
   resize(length);
 
   if(length > 0)
-    ::memcpy(DATA(d), data, length);
+    ::memcpy(d->data, data, length);
 
   return *this;
 }
@@ -346,32 +377,23 @@ ByteVector &ByteVector::setData(const char *data)
 char *ByteVector::data()
 {
   detach();
-  return size() > 0 ? DATA(d) : 0;
+  return size() > 0 ? d->data : 0;
 }
 
 const char *ByteVector::data() const
 {
-  return size() > 0 ? DATA(d) : 0;
+  return size() > 0 ? d->data : 0;
 }
 
 ByteVector ByteVector::mid(uint index, uint length) const
 {
-  ByteVector v;
-
   if(index > size())
-    return v;
+    return ByteVector();
 
-  ConstIterator endIt;
+  if(length > size() - index)
+    length = size() - index;
 
-  if(length < 0xffffffff && length + index < size())
-    endIt = d->data.begin() + index + length;
-  else
-    endIt = d->data.end();
-
-  v.d->data.insert(v.d->data.begin(), ConstIterator(d->data.begin() + index), endIt);
-  v.d->size = v.d->data.size();
-
-  return v;
+  return ByteVector(d->data + index, length);
 }
 
 char ByteVector::at(uint index) const
@@ -483,8 +505,9 @@ ByteVector &ByteVector::append(const ByteVector &v)
   detach();
 
   uint originalSize = d->size;
-  resize(d->size + v.d->size);
-  ::memcpy(DATA(d) + originalSize, DATA(v.d), v.size());
+  uint appendSize = v.d->size;
+  resize(d->size + appendSize);
+  ::memcpy(d->data + originalSize, v.d->data, appendSize);
 
   return *this;
 }
@@ -492,7 +515,6 @@ ByteVector &ByteVector::append(const ByteVector &v)
 ByteVector &ByteVector::clear()
 {
   detach();
-  d->data.clear();
   d->size = 0;
 
   return *this;
@@ -505,12 +527,20 @@ TagLib::uint ByteVector::size() const
 
 ByteVector &ByteVector::resize(uint size, char padding)
 {
+  if(size == d->size)
+    return *this;
+
+  detach();
+
   if(d->size < size) {
-    d->data.reserve(size);
-    d->data.insert(d->data.end(), size - d->size, padding);
+
+    // Grow geometrically so that appending in a loop stays linear.
+
+    if(size > d->capacity)
+      d->reserve(std::max(size, d->capacity + d->capacity / 2));
+
+    ::memset(d->data + d->size, padding, size - d->size);
   }
-  else
-    d->data.erase(d->data.begin() + size, d->data.end());
 
   d->size = size;
 
@@ -519,22 +549,24 @@ ByteVector &ByteVector::resize(uint size, char padding)
 
 ByteVector::Iterator ByteVector::begin()
 {
-  return d->data.begin();
+  detach();
+  return d->data;
 }
 
 ByteVector::ConstIterator ByteVector::begin() const
 {
-  return d->data.begin();
+  return d->data;
 }
 
 ByteVector::Iterator ByteVector::end()
 {
-  return d->data.end();
+  detach();
+  return d->data + d->size;
 }
 
 ByteVector::ConstIterator ByteVector::end() const
 {
-  return d->data.end();
+  return d->data + d->size;
 }
 
 bool ByteVector::isNull() const
@@ -544,7 +576,7 @@ bool ByteVector::isNull() const
 
 bool ByteVector::isEmpty() const
 {
-  return d->data.size() == 0;
+  return d->size == 0;
 }
 
 TagLib::uint ByteVector::checksum() const
@@ -557,22 +589,22 @@ TagLib::uint ByteVector::checksum() const
 
 TagLib::uint ByteVector::toUInt(bool mostSignificantByteFirst) const
 {
-  return toNumber<uint>(d->data, mostSignificantByteFirst);
+  return toNumber<uint>(d->data, d->size, mostSignificantByteFirst);
 }
 
 short ByteVector::toShort(bool mostSignificantByteFirst) const
 {
-  return toNumber<unsigned short>(d->data, mostSignificantByteFirst);
+  return toNumber<unsigned short>(d->data, d->size, mostSignificantByteFirst);
 }
 
 unsigned short ByteVector::toUShort(bool mostSignificantByteFirst) const
 {
-  return toNumber<unsigned short>(d->data, mostSignificantByteFirst);
+  return toNumber<unsigned short>(d->data, d->size, mostSignificantByteFirst);
 }
 
 long long ByteVector::toLongLong(bool mostSignificantByteFirst) const
 {
-  return toNumber<unsigned long long>(d->data, mostSignificantByteFirst);
+  return toNumber<unsigned long long>(d->data, d->size, mostSignificantByteFirst);
 }
 
 const char &ByteVector::operator[](int index) const
@@ -682,7 +714,7 @@ void ByteVector::detach()
 {
   if(d->count() > 1) {
     d->deref();
-    d = new ByteVectorPrivate(d->data);
+    d = new ByteVectorPrivate(d->data, d->size);
   }
 }
 
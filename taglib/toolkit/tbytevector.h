@@ -46,8 +46,8 @@ namespace TagLib {
   {
   public:
 #ifndef DO_NOT_DOCUMENT
-    typedef std::vector<char>::iterator Iterator;
-    typedef std::vector<char>::const_iterator ConstIterator;
+    typedef char *Iterator;
+    typedef const char *ConstIterator;
 #endif
 
     /*!
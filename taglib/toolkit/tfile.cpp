@@ -23,13 +23,21 @@
  *   http://www.mozilla.org/MPL/                                           *
  ***************************************************************************/
 
+// Large file support for the stdio calls below, has to come before any system
+// header.  On 32-bit systems fopen() fails on files above 2 GiB otherwise.
+#ifndef _FILE_OFFSET_BITS
+# define _FILE_OFFSET_BITS 64
+#endif
+
 #include "tfile.h"
 #include "tstring.h"
 #include "tdebug.h"
+#include "tsimd.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <vector>
 
 #ifdef _WIN32
 # include <wchar.h>
@@ -38,10 +46,16 @@
 # define ftruncate _chsize
 #else
 # include <unistd.h>
+# include <sys/mman.h>
 #endif
 
 #include <stdlib.h>
 
+#ifdef _WIN32
+# define fseeko _fseeki64
+# define ftello _ftelli64
+#endif
+
 #ifndef R_OK
 # define R_OK 4
 #endif
@@ -65,19 +79,195 @@ struct FileNameHandle : public std::string
 
 #endif
 
+namespace
+{
+  // Size of the blocks read by find() and rfind(), see File::setSearchBufferSize().
+
+  uint searchBlockSize = 64 * 1024;
+
+  const uint minSearchBlockSize = 1024;
+  const uint maxSearchBlockSize = 256 * 1024;
+
+  // Number of blocks cached by files opened from now on, see
+  // File::setBlockCacheSize().
+
+  uint cacheBlockCount = 0;
+
+  const uint maxCacheBlockCount = 16;
+  const uint cacheBlockSize = 64 * 1024;
+
+  // Returns the last occurence of c in data.  memchr() is vectorized by every
+  // C library we build against, but there is no portable reverse version.
+  // The SSE2 loop needs -msse2 (/arch:SSE2), which the Makefile and the MSVC
+  // project pass; other builds get the plain loop.
+
+  const char *rfindByte(const char *data, ulong dataSize, char c)
+  {
+    const char *p = data + dataSize;
+
+#ifdef TAGLIB_SSE2
+    const __m128i needle = _mm_set1_epi8(c);
+
+    while(p - data >= 16) {
+      p -= 16;
+      int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), needle));
+      if(mask) {
+        int i = 15;
+        while(!(mask & (1 << i)))
+          i--;
+        return p + i;
+      }
+    }
+#endif
+
+    while(p > data) {
+      if(*--p == c)
+        return p;
+    }
+
+    return 0;
+  }
+
+  // Searches for a pattern in memory, used on memory mapped files and on the
+  // blocks read by find() and rfind().
+
+  long findInData(const char *data, ulong dataSize, const char *pattern, ulong patternSize)
+  {
+    if(patternSize == 0 || patternSize > dataSize)
+      return -1;
+
+    const char *end = data + dataSize - patternSize + 1;
+    const char *p = data;
+
+    while(p < end) {
+      p = static_cast<const char *>(::memchr(p, pattern[0], end - p));
+
+      if(!p)
+        return -1;
+
+      if(::memcmp(p, pattern, patternSize) == 0)
+        return p - data;
+
+      p++;
+    }
+
+    return -1;
+  }
+
+  long rfindInData(const char *data, ulong dataSize, const char *pattern, ulong patternSize)
+  {
+    if(patternSize == 0 || patternSize > dataSize)
+      return -1;
+
+    ulong size = dataSize - patternSize + 1;
+
+    while(size > 0) {
+      const char *p = rfindByte(data, size, pattern[0]);
+
+      if(!p)
+        return -1;
+
+      if(::memcmp(p, pattern, patternSize) == 0)
+        return p - data;
+
+      size = p - data;
+    }
+
+    return -1;
+  }
+
+  // Looks for the first \a pattern in \a data that is not preceded by
+  // \a before.  Returns true if that is decided by this block, \a location is
+  // then set to the match or to -1 if \a before came first.
+
+  bool findInBlock(const char *data, ulong dataSize, const ByteVector &pattern,
+                   const ByteVector &before, long *location)
+  {
+    *location = findInData(data, dataSize, pattern.data(), pattern.size());
+
+    if(!before.isNull()) {
+      ulong searchSize = *location >= 0 ? *location + before.size() - 1 : dataSize;
+      if(searchSize > dataSize)
+        searchSize = dataSize;
+
+      if(findInData(data, searchSize, before.data(), before.size()) >= 0) {
+        *location = -1;
+        return true;
+      }
+    }
+
+    return *location >= 0;
+  }
+
+  // The same for rfind(), where \a before stops the search if it comes after
+  // the pattern.
+
+  bool rfindInBlock(const char *data, ulong dataSize, const ByteVector &pattern,
+                    const ByteVector &before, long *location)
+  {
+    *location = rfindInData(data, dataSize, pattern.data(), pattern.size());
+
+    if(!before.isNull()) {
+      const ulong start = *location >= 0 ? *location + 1 : 0;
+
+      if(rfindInData(data + start, dataSize - start, before.data(), before.size()) >= 0) {
+        *location = -1;
+        return true;
+      }
+    }
+
+    return *location >= 0;
+  }
+}
+
 class File::FilePrivate
 {
 public:
   FilePrivate(FileName fileName);
 
+  bool mapFile();
+  void unmapFile();
+
+  const ByteVector &cacheBlock(offset_t offset);
+  void dropCache();
+  ulong read(char *data, ulong length);
+
   FILE *file;
 
   FileNameHandle name;
 
   bool readOnly;
   bool valid;
-  ulong size;
+  offset_t size;
   static const uint bufferSize = 1024;
+
+  // Set if the file is memory mapped, all reads are served from the mapping
+  // and the position is tracked here instead of in the FILE.
+
+  const char *map;
+  ulong mapSize;
+  offset_t mapPosition;
+#ifdef _WIN32
+  HANDLE mapHandle;
+#endif
+
+  // Set if blocks are cached, reads are served from the cache and the
+  // position is tracked here as well.
+
+  struct CacheBlock
+  {
+    CacheBlock() : offset(-1), lastUse(0) {}
+
+    offset_t offset;
+    ByteVector data;
+    ulong lastUse;
+  };
+
+  std::vector<CacheBlock> cache;
+  offset_t cachePosition;
+  ulong cacheClock;
+  ulong cacheHits;
+  ulong cacheMisses;
 };
 
 File::FilePrivate::FilePrivate(FileName fileName) :
@@ -85,7 +275,18 @@ File::FilePrivate::FilePrivate(FileName fileName) :
   name(fileName),
   readOnly(true),
   valid(true),
-  size(0)
+  size(0),
+  map(0),
+  mapSize(0),
+  mapPosition(0),
+#ifdef _WIN32
+  mapHandle(0),
+#endif
+  cache(cacheBlockCount),
+  cachePosition(0),
+  cacheClock(0),
+  cacheHits(0),
+  cacheMisses(0)
 {
   // First try with read / write mode, if that fails, fall back to read only.
 
@@ -118,6 +319,159 @@ File::FilePrivate::FilePrivate(FileName fileName) :
     debug("Could not open file " + String((const char *) name));
 }
 
+bool File::FilePrivate::mapFile()
+{
+  if(!file)
+    return false;
+
+  offset_t position = ftello(file);
+
+  fseeko(file, 0, SEEK_END);
+  offset_t fileSize = ftello(file);
+  fseeko(file, position, SEEK_SET);
+
+  // Files that don't fit into the address space are read through stdio.
+
+  if(fileSize <= 0 || offset_t(size_t(fileSize)) != fileSize || offset_t(ulong(fileSize)) != fileSize)
+    return false;
+
+#ifdef _WIN32
+
+  HANDLE fileHandle = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file)));
+
+  if(fileHandle == INVALID_HANDLE_VALUE)
+    return false;
+
+  mapHandle = CreateFileMapping(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+
+  if(!mapHandle)
+    return false;
+
+  void *data = MapViewOfFile(mapHandle, FILE_MAP_READ, 0, 0, 0);
+
+  if(!data) {
+    CloseHandle(mapHandle);
+    mapHandle = 0;
+    return false;
+  }
+
+#else
+
+  void *data = mmap(0, fileSize, PROT_READ, MAP_SHARED, fileno(file), 0);
+
+  if(data == MAP_FAILED)
+    return false;
+
+#endif
+
+  map = static_cast<const char *>(data);
+  mapSize = fileSize;
+  mapPosition = position;
+
+  // Reads are served from the mapping, there is nothing left to cache.
+
+  cache.clear();
+
+  return true;
+}
+
+void File::FilePrivate::unmapFile()
+{
+  if(!map)
+    return;
+
+#ifdef _WIN32
+  UnmapViewOfFile(map);
+  CloseHandle(mapHandle);
+  mapHandle = 0;
+#else
+  munmap(const_cast<char *>(map), mapSize);
+#endif
+
+  // Continue where the reads on the mapping stopped.
+
+  fseeko(file, mapPosition, SEEK_SET);
+
+  map = 0;
+  mapSize = 0;
+  mapPosition = 0;
+}
+
+const ByteVector &File::FilePrivate::cacheBlock(offset_t offset)
+{
+  CacheBlock *block = &cache[0];
+
+  for(std::vector<CacheBlock>::iterator it = cache.begin(); it != cache.end(); ++it) {
+    if(it->offset == offset) {
+      it->lastUse = ++cacheClock;
+      cacheHits++;
+      return it->data;
+    }
+
+    if(it->lastUse < block->lastUse)
+      block = &*it;
+  }
+
+  // Replace the block that was used the longest time ago.
+
+  cacheMisses++;
+
+  block->offset = offset;
+  block->lastUse = ++cacheClock;
+  block->data.resize(cacheBlockSize);
+
+  fseeko(file, offset, SEEK_SET);
+  block->data.resize(fread(block->data.data(), 1, cacheBlockSize, file));
+
+  return block->data;
+}
+
+void File::FilePrivate::dropCache()
+{
+  if(cache.empty())
+    return;
+
+  // Continue where the reads from the cache stopped.
+
+  fseeko(file, cachePosition, SEEK_SET);
+
+  cache.clear();
+  cachePosition = 0;
+}
+
+ulong File::FilePrivate::read(char *data, ulong length)
+{
+  if(cache.empty())
+    return fread(data, 1, length, file);
+
+  if(cachePosition < 0)
+    return 0;
+
+  ulong count = 0;
+
+  while(count < length) {
+    const offset_t blockOffset = cachePosition - cachePosition % cacheBlockSize;
+    const ByteVector &block = cacheBlock(blockOffset);
+    const ulong start = ulong(cachePosition - blockOffset);
+
+    if(start >= block.size())
+      break;
+
+    const ulong size = block.size() - start < length - count ? block.size() - start : length - count;
+
+    ::memcpy(data + count, block.data() + start, size);
+    count += size;
+    cachePosition += size;
+
+    // A short block is the last one.
+
+    if(block.size() < cacheBlockSize && count < length)
+      break;
+  }
+
+  return count;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // public members
 ////////////////////////////////////////////////////////////////////////////////
@@ -127,8 +481,18 @@ File::File(FileName file)
   d = new FilePrivate(file);
 }
 
+File::File(FileName file, bool memoryMap)
+{
+  d = new FilePrivate(file);
+
+  if(memoryMap && !d->mapFile())
+    debug("File::File() -- Could not map the file, falling back to buffered reads.");
+}
+
 File::~File()
 {
+  d->unmapFile();
+
   if(d->file)
     fclose(d->file);
   delete d;
@@ -149,15 +513,26 @@ ByteVector File::readBlock(ulong length)
   if(length == 0)
     return ByteVector::null;
 
+  if(d->map) {
+    if(d->mapPosition < 0 || d->mapPosition >= offset_t(d->mapSize))
+      return ByteVector::null;
+
+    if(length > d->mapSize - ulong(d->mapPosition))
+      length = d->mapSize - ulong(d->mapPosition);
+
+    ByteVector v(d->map + d->mapPosition, static_cast<uint>(length));
+    d->mapPosition += length;
+    return v;
+  }
+
   if(length > FilePrivate::bufferSize &&
-     length > ulong(File::length()))
+     offset_t(length) > File::length())
   {
-    length = File::length();
+    length = ulong(File::length());
   }
 
   ByteVector v(static_cast<uint>(length));
-  const int count = fread(v.data(), sizeof(char), length, d->file);
-  v.resize(count);
+  v.resize(d->read(v.data(), length));
   return v;
 }
 
@@ -171,93 +546,81 @@ void File::writeBlock(const ByteVector &data)
     return;
   }
 
+  // The mapping and the cache don't follow the file, go back to buffered I/O.
+
+  d->unmapFile();
+  d->dropCache();
+
   fwrite(data.data(), sizeof(char), data.size(), d->file);
 }
 
+const char *File::mappedData(ulong offset, ulong *length) const
+{
+  if(!d->map || offset >= d->mapSize) {
+    *length = 0;
+    return 0;
+  }
+
+  *length = d->mapSize - offset;
+  return d->map + offset;
+}
+
 long File::find(const ByteVector &pattern, long fromOffset, const ByteVector &before)
 {
-  if(!d->file || pattern.size() > d->bufferSize)
+  if(d->map) {
+    if(fromOffset < 0 || ulong(fromOffset) >= d->mapSize)
       return -1;
 
-  // The position in the file that the current buffer starts at.
+    long location;
+    findInBlock(d->map + fromOffset, d->mapSize - fromOffset, pattern, before, &location);
 
-  long bufferOffset = fromOffset;
-  ByteVector buffer;
+    return location >= 0 ? fromOffset + location : -1;
+  }
 
-  // These variables are used to keep track of a partial match that happens at
-  // the end of a buffer.
+  if(!d->file || pattern.isEmpty() || fromOffset < 0)
+    return -1;
 
-  int previousPartialMatch = -1;
-  int beforePreviousPartialMatch = -1;
+  // The file is read in large blocks.  The end of each block that could hold
+  // the start of a match is carried over to the front of the next one, so
+  // that matches crossing a block boundary are found as a whole.
 
-  // Save the location of the current read pointer.  We will restore the
-  // position using seek() before all returns.
+  const uint overlap = (pattern.size() > before.size() ? pattern.size() : before.size()) - 1;
 
-  long originalPosition = tell();
+  if(overlap >= searchBlockSize)
+    return -1;
 
-  // Start the search at the offset.
+  ByteVector buffer(searchBlockSize + overlap, 0);
+  char *data = buffer.data();
 
-  seek(fromOffset);
+  // The position in the file that the buffer starts at.
 
-  // This loop is the crux of the find method.  There are three cases that we
-  // want to account for:
-  //
-  // (1) The previously searched buffer contained a partial match of the search
-  // pattern and we want to see if the next one starts with the remainder of
-  // that pattern.
-  //
-  // (2) The search pattern is wholly contained within the current buffer.
-  //
-  // (3) The current buffer ends with a partial match of the pattern.  We will
-  // note this for use in the next itteration, where we will check for the rest
-  // of the pattern.
-  //
-  // All three of these are done in two steps.  First we check for the pattern
-  // and do things appropriately if a match (or partial match) is found.  We
-  // then check for "before".  The order is important because it gives priority
-  // to "real" matches.
+  long bufferOffset = fromOffset;
+  ulong carry = 0;
 
-  for(buffer = readBlock(d->bufferSize); buffer.size() > 0; buffer = readBlock(d->bufferSize)) {
+  // Save the location of the current read pointer.  We will restore the
+  // position using seek() before all returns.
 
-    // (1) previous partial match
+  offset_t originalPosition = tell();
 
-    if(previousPartialMatch >= 0 && int(d->bufferSize) > previousPartialMatch) {
-      const int patternOffset = (d->bufferSize - previousPartialMatch);
-      if(buffer.containsAt(pattern, 0, patternOffset)) {
-        seek(originalPosition);
-        return bufferOffset - d->bufferSize + previousPartialMatch;
-      }
-    }
+  seek(fromOffset);
 
-    if(!before.isNull() && beforePreviousPartialMatch >= 0 && int(d->bufferSize) > beforePreviousPartialMatch) {
-      const int beforeOffset = (d->bufferSize - beforePreviousPartialMatch);
-      if(buffer.containsAt(before, 0, beforeOffset)) {
-        seek(originalPosition);
-        return -1;
-      }
-    }
+  for(;;) {
+    const ulong count = d->read(data + carry, searchBlockSize);
 
-    // (2) pattern contained in current buffer
+    if(count == 0)
+      break;
 
-    long location = buffer.find(pattern);
-    if(location >= 0) {
-      seek(originalPosition);
-      return bufferOffset + location;
-    }
+    const ulong size = carry + count;
+    long location;
 
-    if(!before.isNull() && buffer.find(before) >= 0) {
+    if(findInBlock(data, size, pattern, before, &location)) {
       seek(originalPosition);
-      return -1;
+      return location >= 0 ? bufferOffset + location : -1;
     }
 
-    // (3) partial match
-
-    previousPartialMatch = buffer.endsWithPartialMatch(pattern);
-
-    if(!before.isNull())
-      beforePreviousPartialMatch = buffer.endsWithPartialMatch(before);
-
-    bufferOffset += d->bufferSize;
+    carry = size < overlap ? size : overlap;
+    ::memmove(data, data + size - carry, carry);
+    bufferOffset += size - carry;
   }
 
   // Since we hit the end of the file, reset the status before continuing.
@@ -272,61 +635,61 @@ long File::find(const ByteVector &pattern, long fromOffset, const ByteVector &be
 
 long File::rfind(const ByteVector &pattern, long fromOffset, const ByteVector &before)
 {
-  if(!d->file || pattern.size() > d->bufferSize)
-      return -1;
+  if(d->map) {
+    const ulong dataSize = fromOffset > 0 && ulong(fromOffset) < d->mapSize ? fromOffset : d->mapSize;
 
-  // The position in the file that the current buffer starts at.
+    long location;
+    rfindInBlock(d->map, dataSize, pattern, before, &location);
 
-  ByteVector buffer;
+    return location;
+  }
 
-  // These variables are used to keep track of a partial match that happens at
-  // the end of a buffer.
+  if(!d->file || pattern.isEmpty())
+    return -1;
 
-  /*
-  int previousPartialMatch = -1;
-  int beforePreviousPartialMatch = -1;
-  */
+  // See the notes in find(), here the start of each block is carried over to
+  // the end of the one before it.
 
-  // Save the location of the current read pointer.  We will restore the
-  // position using seek() before all returns.
+  const uint overlap = (pattern.size() > before.size() ? pattern.size() : before.size()) - 1;
 
-  long originalPosition = tell();
+  if(overlap >= searchBlockSize)
+    return -1;
 
-  // Start the search at the offset.
+  ByteVector buffer(searchBlockSize + overlap, 0);
+  char *data = buffer.data();
 
-  long bufferOffset;
-  if(fromOffset == 0) {
-    seek(-1 * int(d->bufferSize), End);
-    bufferOffset = tell();
-  }
-  else {
-    seek(fromOffset + -1 * int(d->bufferSize), Beginning);
-    bufferOffset = tell();
-  }
+  offset_t originalPosition = tell();
 
-  // See the notes in find() for an explanation of this algorithm.
+  // The search covers everything before fromOffset, or the whole file.
 
-  for(buffer = readBlock(d->bufferSize); buffer.size() > 0; buffer = readBlock(d->bufferSize)) {
+  seek(0, End);
+  long bufferOffset = tell();
 
-    // TODO: (1) previous partial match
+  if(fromOffset > 0 && fromOffset < bufferOffset)
+    bufferOffset = fromOffset;
 
-    // (2) pattern contained in current buffer
+  ulong carry = 0;
 
-    long location = buffer.rfind(pattern);
-    if(location >= 0) {
-      seek(originalPosition);
-      return bufferOffset + location;
-    }
+  while(bufferOffset > 0) {
+    const ulong count = ulong(bufferOffset) < searchBlockSize ? bufferOffset : searchBlockSize;
 
-    if(!before.isNull() && buffer.find(before) >= 0) {
+    bufferOffset -= count;
+    ::memmove(data + count, data, carry);
+
+    seek(bufferOffset);
+
+    if(d->read(data, count) != count)
+      break;
+
+    const ulong size = count + carry;
+    long location;
+
+    if(rfindInBlock(data, size, pattern, before, &location)) {
       seek(originalPosition);
-      return -1;
+      return location >= 0 ? bufferOffset + location : -1;
     }
 
-    // TODO: (3) partial match
-
-    bufferOffset -= d->bufferSize;
-    seek(bufferOffset);
+    carry = size < overlap ? size : overlap;
   }
 
   // Since we hit the end of the file, reset the status before continuing.
@@ -338,11 +701,49 @@ long File::rfind(const ByteVector &pattern, long fromOffset, const ByteVector &b
   return -1;
 }
 
+uint File::searchBufferSize()
+{
+  return searchBlockSize;
+}
+
+void File::setSearchBufferSize(uint size)
+{
+  if(size < minSearchBlockSize)
+    size = minSearchBlockSize;
+  else if(size > maxSearchBlockSize)
+    size = maxSearchBlockSize;
+
+  searchBlockSize = size;
+}
+
+uint File::blockCacheSize()
+{
+  return cacheBlockCount;
+}
+
+void File::setBlockCacheSize(uint blocks)
+{
+  cacheBlockCount = blocks < maxCacheBlockCount ? blocks : maxCacheBlockCount;
+}
+
+ulong File::blockCacheHits() const
+{
+  return d->cacheHits;
+}
+
+ulong File::blockCacheMisses() const
+{
+  return d->cacheMisses;
+}
+
 void File::insert(const ByteVector &data, ulong start, ulong replace)
 {
   if(!d->file)
     return;
 
+  d->unmapFile();
+  d->dropCache();
+
   if(data.size() == replace) {
     seek(start);
     writeBlock(data);
@@ -441,6 +842,9 @@ void File::removeBlock(ulong start, ulong length)
   if(!d->file)
     return;
 
+  d->unmapFile();
+  d->dropCache();
+
   ulong bufferLength = bufferSize();
 
   long readPosition = start + length;
@@ -488,22 +892,54 @@ bool File::isValid() const
   return isOpen() && d->valid;
 }
 
-void File::seek(long offset, Position p)
+void File::seek(offset_t offset, Position p)
 {
   if(!d->file) {
     debug("File::seek() -- trying to seek in a file that isn't opened.");
     return;
   }
 
+  if(d->map) {
+    offset_t position = offset;
+
+    if(p == Current)
+      position += d->mapPosition;
+    else if(p == End)
+      position += d->mapSize;
+
+    // Like fseek(), seeking before the beginning fails
+
+    if(position >= 0)
+      d->mapPosition = position;
+
+    return;
+  }
+
+  if(!d->cache.empty()) {
+    offset_t position = offset;
+
+    if(p == Current)
+      position += d->cachePosition;
+    else if(p == End) {
+      fseeko(d->file, 0, SEEK_END);
+      position += ftello(d->file);
+    }
+
+    if(position >= 0)
+      d->cachePosition = position;
+
+    return;
+  }
+
   switch(p) {
   case Beginning:
-    fseek(d->file, offset, SEEK_SET);
+    fseeko(d->file, offset, SEEK_SET);
     break;
   case Current:
-    fseek(d->file, offset, SEEK_CUR);
+    fseeko(d->file, offset, SEEK_CUR);
     break;
   case End:
-    fseek(d->file, offset, SEEK_END);
+    fseeko(d->file, offset, SEEK_END);
     break;
   }
 }
@@ -513,12 +949,18 @@ void File::clear()
   clearerr(d->file);
 }
 
-long File::tell() const
+offset_t File::tell() const
 {
-  return ftell(d->file);
+  if(d->map)
+    return d->mapPosition;
+
+  if(!d->cache.empty())
+    return d->cachePosition;
+
+  return ftello(d->file);
 }
 
-long File::length()
+offset_t File::length()
 {
   // Do some caching in case we do multiple calls.
 
@@ -528,10 +970,29 @@ long File::length()
   if(!d->file)
     return 0;
 
-  long curpos = tell();
+  if(d->map) {
+    d->size = d->mapSize;
+    return d->size;
+  }
+
+  // Seeking to the end and back makes stdio read the last block and the one
+  // it returns to.  Ask the file system first.
+
+#ifdef _WIN32
+  struct _stat64 st;
+  if(_fstat64(_fileno(d->file), &st) == 0 && (st.st_mode & _S_IFREG)) {
+#else
+  struct stat st;
+  if(fstat(fileno(d->file), &st) == 0 && S_ISREG(st.st_mode)) {
+#endif
+    d->size = st.st_size;
+    return d->size;
+  }
+
+  offset_t curpos = tell();
 
   seek(0, End);
-  long endpos = tell();
+  offset_t endpos = tell();
 
   seek(curpos, Beginning);
 
@@ -553,8 +1014,11 @@ void File::setValid(bool valid)
   d->valid = valid;
 }
 
-void File::truncate(long length)
+void File::truncate(offset_t length)
 {
+  d->unmapFile();
+  d->dropCache();
+
   ftruncate(fileno(d->file), length);
 }
 
@@ -115,6 +115,16 @@ namespace TagLib {
      */
     ByteVector readBlock(ulong length);
 
+    /*!
+     * Returns a pointer to the contents of the file starting at \a offset and
+     * sets \a length to the number of bytes that can be read from it, if the
+     * file is memory mapped.  Otherwise, or if \a offset is past the end of the
+     * file, this returns a null pointer and sets \a length to 0.
+     *
+     * \note The pointer is only valid until the file is modified or destroyed.
+     */
+    const char *mappedData(ulong offset, ulong *length) const;
+
     /*!
      * Attempts to write the block \a data at the current get pointer.  If the
      * file is currently only opened read only -- i.e. readOnly() returns true --
@@ -136,7 +146,7 @@ namespace TagLib {
      * file.
      *
      * \note This has the practial limitation that \a pattern can not be longer
-     * than the buffer size used by readBlock().  Currently this is 1024 bytes.
+     * than searchBufferSize().
      */
     long find(const ByteVector &pattern,
               long fromOffset = 0,
@@ -149,15 +159,59 @@ namespace TagLib {
      * for a tag before the synch frame.
      *
      * Searching starts at \a fromOffset and proceeds from the that point to the
-     * beginning of the file and defaults to the end of the file.
+     * beginning of the file and defaults to the end of the file.  Only matches
+     * that end before \a fromOffset are returned.
      *
      * \note This has the practial limitation that \a pattern can not be longer
-     * than the buffer size used by readBlock().  Currently this is 1024 bytes.
+     * than searchBufferSize().
      */
     long rfind(const ByteVector &pattern,
                long fromOffset = 0,
                const ByteVector &before = ByteVector::null);
 
+    /*!
+     * Returns the size of the blocks that find() and rfind() read at once.
+     * This defaults to 64 KiB.
+     */
+    static uint searchBufferSize();
+
+    /*!
+     * Sets the size of the blocks that find() and rfind() read at once to
+     * \a size, which is kept between 1 KiB and 256 KiB.
+     *
+     * \note This is shared by all files and should be set before any of them
+     * are searched.
+     */
+    static void setSearchBufferSize(uint size);
+
+    /*!
+     * Returns the number of 64 KiB blocks that files keep in memory, see
+     * setBlockCacheSize().
+     */
+    static uint blockCacheSize();
+
+    /*!
+     * Lets files that are opened from now on keep the last \a blocks blocks of
+     * 64 KiB that they read in memory, up to 16.  All reads and searches go
+     * through those, so probing the same parts of a file again doesn't touch
+     * the disk.  0, the default, turns the cache off.  Memory mapped files
+     * don't use it.
+     *
+     * \note This is shared by all files and should be set before any of them
+     * are opened.
+     */
+    static void setBlockCacheSize(uint blocks);
+
+    /*!
+     * Returns how many reads were served from the block cache of this file.
+     */
+    ulong blockCacheHits() const;
+
+    /*!
+     * Returns how many blocks had to be read into the block cache of this file.
+     */
+    ulong blockCacheMisses() const;
+
     /*!
      * Insert \a data at position \a start in the file overwriting \a replace
      * bytes of the original content.
@@ -198,7 +252,7 @@ namespace TagLib {
      *
      * \see Position
      */
-    void seek(long offset, Position p = Beginning);
+    void seek(offset_t offset, Position p = Beginning);
 
     /*!
      * Reset the end-of-file and error flags on the file.
@@ -208,12 +262,12 @@ namespace TagLib {
     /*!
      * Returns the current offset within the file.
      */
-    long tell() const;
+    offset_t tell() const;
 
     /*!
      * Returns the length of the file.
      */
-    long length();
+    offset_t length();
 
     /*!
      * Returns true if \a file can be opened for reading.  If the file does not
@@ -240,6 +294,14 @@ namespace TagLib {
      */
     File(FileName file);
 
+    /*!
+     * Construct a File object and opens the \a file.  If \a memoryMap is true
+     * the file is mapped into memory and all reads are served from there
+     * until it is modified.  If mapping fails buffered reads are used.
+     */
+    // BIC: merge with the above constructor
+    File(FileName file, bool memoryMap);
+
     /*!
      * Marks the file as valid or invalid.
      *
@@ -250,7 +312,7 @@ namespace TagLib {
     /*!
      * Truncates the file to a \a length.
      */
-    void truncate(long length);
+    void truncate(offset_t length);
 
     /*!
      * Returns the buffer size that is used for internal buffering.
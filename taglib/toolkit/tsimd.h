@@ -0,0 +1,42 @@
+/***************************************************************************
+ *   This library is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License version   *
+ *   2.1 as published by the Free Software Foundation.                     *
+ *                                                                         *
+ *   This library is distributed in the hope that it will be useful, but   *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU     *
+ *   Lesser General Public License for more details.                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this library; if not, write to the Free Software   *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA         *
+ *   02110-1301  USA                                                       *
+ *                                                                         *
+ *   Alternatively, this file is available under the Mozilla Public        *
+ *   License Version 1.1.  You may obtain a copy of the License at         *
+ *   http://www.mozilla.org/MPL/                                           *
+ ***************************************************************************/
+
+#ifndef TAGLIB_SIMD_H
+#define TAGLIB_SIMD_H
+
+#ifndef DO_NOT_DOCUMENT
+
+/*
+ * \internal
+ * Vector instructions used by the scanning loops.  SSE2 is only enabled if
+ * the compiler targets it (-msse2 in the Makefile, /arch:SSE2 in the MSVC
+ * project or the x64 defaults), every user has to keep a plain C++ fallback.
+ * Wider instruction sets would need runtime CPU dispatch and are not used.
+ * This header is not installed.
+ */
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define TAGLIB_SSE2
+#endif
+
+#endif
+
+#endif
@@ -42,6 +42,33 @@ namespace TagLib {
   {
     return (c1 << 8) | c2;
   }
+
+  /*
+   * Returns true if every character is 7-bit ASCII, in which case the UTF-8
+   * conversions are plain copies.  The characters are or'ed together a block
+   * at a time so that the compiler can vectorize the inner loop.
+   */
+  inline bool containsOnlyAscii(const wstring &s)
+  {
+    const wchar_t *data = s.data();
+    const size_t size = s.size();
+    const size_t blockSize = 16;
+
+    size_t i = 0;
+    for(; i + blockSize <= size; i += blockSize) {
+      unsigned int bits = 0;
+      for(size_t j = 0; j < blockSize; j++)
+        bits |= (unsigned int)data[i + j];
+      if(bits & ~0x7fU)
+        return false;
+    }
+
+    unsigned int bits = 0;
+    for(; i < size; i++)
+      bits |= (unsigned int)data[i];
+
+    return !(bits & ~0x7fU);
+  }
 }
 
 using namespace TagLib;
@@ -207,12 +234,23 @@ std::string String::to8Bit(bool unicode) const
   std::string s;
   s.resize(d->data.size());
 
-  if(!unicode) {
+  const bool ascii = unicode && containsOnlyAscii(d->data);
+
+  if(!unicode || ascii) {
     std::string::iterator targetIt = s.begin();
     for(wstring::const_iterator it = d->data.begin(); it != d->data.end(); it++) {
       *targetIt = char(*it);
       ++targetIt;
     }
+
+    // The UTF-8 conversion below ends at the first null character
+
+    if(ascii) {
+      std::string::size_type end = s.find('\0');
+      if(end != std::string::npos)
+        s.resize(end);
+    }
+
     return s;
   }
 
@@ -493,11 +531,7 @@ bool String::isLatin1() const
 
 bool String::isAscii() const
 {
-  for(wstring::const_iterator it = d->data.begin(); it != d->data.end(); it++) {
-    if(*it >= 128)
-      return false;
-  }
-  return true;
+  return containsOnlyAscii(d->data);
 }
 
 String String::number(int n) // static
@@ -736,6 +770,9 @@ void String::prepare(Type t)
   }
   case UTF8:
   {
+    if(containsOnlyAscii(d->data))
+      break;
+
     int bufferSize = d->data.size() + 1;
     Unicode::UTF8  *sourceBuffer = new Unicode::UTF8[bufferSize];
     Unicode::UTF16 *targetBuffer = new Unicode::UTF16[bufferSize];